@@ -0,0 +1,72 @@
+#include "aot.hpp"
+#include <cstring>
+
+Aot::Aot(Chip8& chip8, const AotProgram& program) : chip8(chip8), program(program) {
+    for (size_t i = 0; i < program.block_count; i++) {
+        const AotBlock& block = program.blocks[i];
+        if (matches(block)) blocks[block.address] = &block;
+        memset(&code_map[block.address], 1, 2u * block.length);
+    }
+}
+
+std::vector<const AotProgram*>& Aot::registry() {
+    static std::vector<const AotProgram*> registered;
+    return registered;
+}
+
+bool Aot::add(const AotProgram& program) {
+    registry().push_back(&program);
+    return true;
+}
+
+const std::vector<const AotProgram*>& Aot::programs() {
+    return registry();
+}
+
+//First registered program whose bytes are in memory at START_ADDRESS
+const AotProgram* Aot::find(const Chip8& chip8) {
+    if (chip8.machine != Machine::Chip8) return nullptr;
+
+    uint8_t memory[MEM_SIZE - START_ADDRESS];
+    chip8.readBlock(START_ADDRESS, memory, sizeof(memory));
+    for (const AotProgram* program : registry()) {
+        if (program->size <= sizeof(memory) && memcmp(memory, program->rom, program->size) == 0) return program;
+    }
+    return nullptr;
+}
+
+//True if memory under the block still holds the bytes it was generated from
+bool Aot::matches(const AotBlock& block) const {
+    uint8_t memory[MEM_SIZE];
+    chip8.readBlock(block.address, memory, 2u * block.length);
+    return memcmp(memory, &program.rom[block.address - START_ADDRESS], 2u * block.length) == 0;
+}
+
+unsigned int Aot::run(unsigned int budget) {
+    const AotBlock* block = blocks[chip8.program_counter & (MEM_SIZE - 1)];
+    if (!block || block->length > budget) {
+        chip8.cycle();
+        return 1;
+    }
+
+    block->code(chip8);
+    return block->length;
+}
+
+//Self-modifying code disables only the blocks it overwrote, and restoring the bytes
+//(rewind, reloading the ROM) enables them again
+void Aot::invalidate(uint16_t address, uint16_t length) {
+    unsigned int start = address;
+    unsigned int end = start + length;
+
+    bool code = false;
+    for (unsigned int i = start; i < end && !code; i++) code = code_map[i & (MEM_SIZE - 1)] != 0;
+    if (!code) return;
+
+    for (size_t i = 0; i < program.block_count; i++) {
+        const AotBlock& block = program.blocks[i];
+        if (block.address < end && start < block.address + 2u * block.length) {
+            blocks[block.address] = matches(block) ? &block : nullptr;
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "chip8.hpp"
+#include "specialized.hpp"
+
+//Runtime side of ahead-of-time recompiled ROMs
+//The recompile tool turns a ROM into C++ with one function per basic block, built from
+//Specialized handlers, and registers it as an AotProgram. Selecting Engine::Aot on a machine
+//whose memory holds a registered ROM runs those blocks. Addresses without a block (computed
+//Bnnn targets, code the CFG walk didn't reach) and blocks whose bytes were overwritten since
+//load run on the interpreter, one instruction at a time
+
+typedef void (*AotBlockFunc)(Chip8& chip8);
+
+struct AotBlock {
+    uint16_t address;
+    uint16_t length; //Instructions, the block covers 2 * length bytes from address
+    AotBlockFunc code;
+};
+
+struct AotProgram {
+    const char* name;
+    //Program bytes the blocks were generated from, loaded at START_ADDRESS
+    const uint8_t* rom;
+    size_t size;
+    const AotBlock* blocks;
+    size_t block_count;
+};
+
+class Aot {
+    public:
+        Aot(Chip8& chip8, const AotProgram& program);
+
+        //Registers a recompiled program, called from static initializers in generated files
+        static bool add(const AotProgram& program);
+        static const std::vector<const AotProgram*>& programs();
+        //Registered program whose ROM is in memory, or nullptr
+        static const AotProgram* find(const Chip8& chip8);
+
+        //Runs block at current program counter, returns number of instructions executed
+        //Falls back to one interpreted cycle if there's no usable block or it is longer than budget
+        unsigned int run(unsigned int budget);
+
+        //Re-checks blocks overlapping memory[address, address + length) against the ROM
+        void invalidate(uint16_t address, uint16_t length);
+
+        //Used by generated code: program counter is advanced past the instruction first, as in cycle()
+        //Blocks run in sequence from their start, so this keeps any bits above the memory size
+        template <uint16_t Opcode>
+        static void step(Chip8& chip8) {
+            chip8.program_counter += 2;
+            Specialized::execute<Opcode>(chip8);
+        }
+
+    private:
+        static std::vector<const AotProgram*>& registry();
+
+        bool matches(const AotBlock& block) const;
+
+        Chip8& chip8;
+        const AotProgram& program;
+
+        //Block starting at each address, nullptr if none or modified
+        const AotBlock* blocks[MEM_SIZE]{};
+        //Marks addresses covered by any block, so writes to data return early
+        uint8_t code_map[MEM_SIZE]{};
+};
@@ -0,0 +1,107 @@
+#include "arena.hpp"
+#include <cstdint>
+#include <new>
+
+namespace {
+
+std::atomic<unsigned int> next_id{0};
+
+}
+
+Arena::Arena(size_t block_size, size_t blocks_per_slab)
+    :block_size((block_size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT), blocks_per_slab(blocks_per_slab),
+    id(next_id.fetch_add(1, std::memory_order_relaxed)) {
+}
+
+Arena::~Arena() {
+    for (void* slab : slabs) ::operator delete(slab, std::align_val_t{ALIGNMENT});
+}
+
+Arena::ThreadCaches::~ThreadCaches() {
+    for (Cache& cache : caches) {
+        if (cache.owner && cache.count) cache.owner->drain(cache, cache.count);
+    }
+}
+
+Arena::ThreadCaches& Arena::threadCaches() {
+    static thread_local ThreadCaches caches{};
+    return caches;
+}
+
+Arena::FreeBlock* Arena::take() {
+    if (!free_list) {
+        //Threads the new slab's blocks onto the free list, first block on top
+        uint8_t* slab = static_cast<uint8_t*>(::operator new(block_size * blocks_per_slab, std::align_val_t{ALIGNMENT}));
+        slabs.push_back(slab);
+        for (size_t i = blocks_per_slab; i-- > 0;) {
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(slab + i * block_size);
+            block->next = free_list;
+            free_list = block;
+        }
+    }
+
+    FreeBlock* block = free_list;
+    free_list = block->next;
+    return block;
+}
+
+void Arena::refill(Cache& cache) {
+    cache.owner = this;
+    std::lock_guard<std::mutex> guard(lock);
+    while (cache.count < BATCH) {
+        FreeBlock* block = take();
+        block->next = cache.head;
+        cache.head = block;
+        cache.count++;
+    }
+}
+
+void Arena::drain(Cache& cache, size_t count) {
+    //Unlinks the run outside the lock, then splices it on in one step
+    FreeBlock* first = cache.head;
+    FreeBlock* last = first;
+    for (size_t i = 1; i < count; i++) last = last->next;
+    cache.head = last->next;
+    cache.count -= count;
+
+    std::lock_guard<std::mutex> guard(lock);
+    last->next = free_list;
+    free_list = first;
+}
+
+void* Arena::allocate() {
+    allocated.fetch_add(1, std::memory_order_relaxed);
+    if (id >= MAX_CACHED) {
+        std::lock_guard<std::mutex> guard(lock);
+        return take();
+    }
+
+    Cache& cache = threadCaches().caches[id];
+    if (!cache.head) refill(cache);
+    FreeBlock* block = cache.head;
+    cache.head = block->next;
+    cache.count--;
+    return block;
+}
+
+void Arena::release(void* block) {
+    allocated.fetch_sub(1, std::memory_order_relaxed);
+    FreeBlock* freed = static_cast<FreeBlock*>(block);
+    if (id >= MAX_CACHED) {
+        std::lock_guard<std::mutex> guard(lock);
+        freed->next = free_list;
+        free_list = freed;
+        return;
+    }
+
+    //A thread that mostly frees (e.g. dropping forks made elsewhere) hands blocks back in batches
+    Cache& cache = threadCaches().caches[id];
+    cache.owner = this;
+    freed->next = cache.head;
+    cache.head = freed;
+    if (++cache.count >= 2 * BATCH) drain(cache, BATCH);
+}
+
+size_t Arena::used() const {
+    return allocated.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+//Fixed-size block allocator
+//Blocks are carved from large slabs and recycled through free lists, slabs are only freed with
+//the arena, so a search loop forking and dropping machines never reaches malloc once warm
+//Each thread keeps its own free list per arena and trades blocks with the shared list in
+//batches, so threads forking in parallel rarely meet on the lock. Arenas must outlive every
+//thread that used them, a thread hands its blocks back when it exits
+//Blocks are cache line aligned, pages written by machines on different threads don't share lines
+class Arena {
+    public:
+        Arena(size_t block_size, size_t blocks_per_slab);
+        ~Arena();
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        void* allocate();
+        void release(void* block);
+
+        //Blocks handed out and not yet released
+        size_t used() const;
+
+    private:
+        static const size_t ALIGNMENT = 64;
+        //Blocks moved between a thread's list and the shared one at a time
+        static const size_t BATCH = 32;
+        //Arenas created after this many have no thread lists and always take the lock
+        static const unsigned int MAX_CACHED = 8;
+
+        struct FreeBlock {
+            FreeBlock* next;
+        };
+
+        //One thread's free list for one arena
+        struct Cache {
+            Arena* owner;
+            FreeBlock* head;
+            size_t count;
+        };
+        struct ThreadCaches {
+            Cache caches[MAX_CACHED];
+            ~ThreadCaches();
+        };
+
+        static ThreadCaches& threadCaches();
+        //Pops a block off the shared list, carving a new slab if it's empty; lock must be held
+        FreeBlock* take();
+        //Moves up to BATCH blocks from the shared list onto cache
+        void refill(Cache& cache);
+        //Moves count blocks from the top of cache back to the shared list
+        void drain(Cache& cache, size_t count);
+
+        size_t block_size;
+        size_t blocks_per_slab;
+        //Slot in every thread's caches, MAX_CACHED or more if this arena has none
+        unsigned int id;
+
+        std::mutex lock;
+        std::vector<void*> slabs;
+        FreeBlock* free_list{};
+        std::atomic<size_t> allocated{};
+};
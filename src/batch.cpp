@@ -0,0 +1,315 @@
+#include "capture.hpp"
+#include "chip8.hpp"
+#include "movie.hpp"
+#include "rom.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//Headless batch runner
+//Runs every (ROM, seed) pair for a fixed number of cycles or frames across all cores
+//Prints one line per job: final framebuffer hash, registers and instructions/second, plus VIP
+//machine cycles and speed relative to a real VIP under --vip
+
+namespace {
+
+//Scripted key transition: at cycle, set keypad[key] = pressed
+struct KeyEvent {
+    uint64_t cycle;
+    uint8_t key;
+    uint8_t pressed;
+};
+
+struct Job {
+    std::string rom;
+    std::shared_ptr<const RomImage> image;
+    uint32_t seed;
+    Quirks quirks;
+};
+
+struct Options {
+    uint64_t cycles = 1000000;
+    unsigned int instructions_per_frame = 10;
+    uint32_t seeds = 1;
+    unsigned int threads = 0;
+    bool jit = false;
+    bool specialized = false;
+    bool aot = false;
+    bool idle_skip = true;
+    //COSMAC VIP timing, see Chip8::runCycles(); runs this many frames instead of cycles
+    bool vip = false;
+    uint64_t frames = 0;
+    Machine machine = Machine::Chip8;
+    std::vector<KeyEvent> script;
+    uint32_t first_seed = 0;
+    uint64_t movie_hash = 0;
+    std::string capture;
+    //Replaces each ROM's .quirks file when set
+    std::string quirks;
+    std::vector<std::string> roms;
+};
+
+//Input script format: one "<cycle> <key hex> <0|1>" per line, sorted by cycle, # starts a comment
+bool loadScript(const char* filename, std::vector<KeyEvent>& script) {
+    std::ifstream file(filename);
+    if (!file.is_open()) return false;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream fields(line);
+        uint64_t cycle;
+        unsigned int key, pressed;
+        if (!(fields >> cycle >> std::hex >> key >> std::dec >> pressed)) return false;
+
+        script.push_back({cycle, static_cast<uint8_t>(key & 0xFu), static_cast<uint8_t>(pressed != 0)});
+    }
+    return true;
+}
+
+std::string runJob(const Job& job, const Options& options) {
+    Chip8 chip8;
+    chip8.seed(job.seed);
+    chip8.setMachine(options.machine);
+    chip8.loadRom(*job.image);
+    chip8.setQuirks(job.quirks);
+    if (options.jit) chip8.setEngine(Engine::Jit);
+    if (options.specialized) chip8.setEngine(Engine::Specialized);
+    if (options.aot) chip8.setEngine(Engine::Aot);
+    chip8.setIdleSkip(options.idle_skip);
+
+    //Frame capture only runs for single-job invocations, see main()
+    FrameCapture capture;
+    if (!options.capture.empty() && !capture.open(options.capture.c_str())) {
+        std::cerr << "Could not write capture " << options.capture << "\n";
+    }
+
+    size_t next_event = 0;
+    uint64_t executed = 0;
+    uint64_t vip_cycles = 0;
+    uint64_t frame_end = options.instructions_per_frame;
+    auto start = std::chrono::steady_clock::now();
+
+    if (options.vip) {
+        //Frames spend VIP cycles, script events apply at the first frame starting past their instruction
+        chip8.setDisplayWait(true);
+        uint32_t overshoot = 0;
+        for (uint64_t frame = 1; frame <= options.frames; frame++) {
+            while (next_event < options.script.size() && options.script[next_event].cycle <= executed) {
+                const KeyEvent& event = options.script[next_event++];
+                chip8.keypad[event.key] = event.pressed;
+            }
+
+            uint32_t budget = VIP_CYCLES_PER_FRAME - overshoot;
+            uint32_t used;
+            executed += chip8.runCycles(budget, used);
+            overshoot = used - budget;
+            vip_cycles += used;
+            chip8.tickTimers();
+            capture.submit(chip8.video, frame);
+        }
+    }
+
+    //Runs up to the next key event or frame boundary, timers tick every instructions_per_frame
+    while (!options.vip && executed < options.cycles) {
+        while (next_event < options.script.size() && options.script[next_event].cycle <= executed) {
+            const KeyEvent& event = options.script[next_event++];
+            chip8.keypad[event.key] = event.pressed;
+        }
+
+        uint64_t stop = std::min(options.cycles, frame_end);
+        if (next_event < options.script.size()) stop = std::min(stop, options.script[next_event].cycle);
+
+        executed += chip8.run(static_cast<unsigned int>(stop - executed));
+        if (executed == frame_end) {
+            chip8.tickTimers();
+            capture.submit(chip8.video, frame_end / options.instructions_per_frame);
+            frame_end += options.instructions_per_frame;
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t video_hash = chip8.hashDisplay();
+
+    char line[256];
+    int length = snprintf(line, sizeof(line), "%s seed=%u cycles=%llu hash=%016llx pc=%03x i=%03x v=",
+        job.rom.c_str(), job.seed, static_cast<unsigned long long>(executed),
+        static_cast<unsigned long long>(video_hash), chip8.getProgramCounter(), chip8.getIndex());
+
+    std::string result(line, length);
+    for (unsigned int i = 0; i < REG_COUNT; i++) {
+        snprintf(line, sizeof(line), "%02x", chip8.getRegister(i));
+        result += line;
+    }
+    snprintf(line, sizeof(line), " ips=%.0f", seconds > 0 ? executed / seconds : 0.0);
+    result += line;
+    if (options.vip) {
+        //Emulated time is the frames run at 60 Hz
+        double emulated = static_cast<double>(options.frames) / 60;
+        snprintf(line, sizeof(line), " vip_cycles=%llu speed=%.0fx", static_cast<unsigned long long>(vip_cycles), seconds > 0 ? emulated / seconds : 0.0);
+        result += line;
+    }
+
+    //Replaying a whole movie must end on the framebuffer it was recorded with
+    //Never under --vip, which main() rejects together with --movie
+    if (options.movie_hash && executed == options.cycles) {
+        result += options.movie_hash == video_hash ? " movie=match" : " movie=MISMATCH";
+    }
+
+    return result;
+}
+
+void usage(const char* program) {
+    std::cerr << "Usage: " << program << " [--cycles N | --frames N] [--ipf N] [--seeds N] [--threads N] [--input script | --movie file] [--capture file] [--schip | --xochip] [--quirks list] [--vip] [--jit | --specialized | --aot] [--no-idle-skip] <ROM>...\n";
+    std::exit(EXIT_FAILURE);
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    uint64_t frames = 0;
+    MovieReader movie;
+    bool has_movie = false;
+    bool cycles_given = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--cycles" && has_value) {
+            options.cycles = std::stoull(argv[++i]);
+            cycles_given = true;
+        }
+        else if (arg == "--frames" && has_value) frames = std::stoull(argv[++i]);
+        else if (arg == "--ipf" && has_value) options.instructions_per_frame = std::max(1ul, std::stoul(argv[++i]));
+        else if (arg == "--seeds" && has_value) options.seeds = std::stoul(argv[++i]);
+        else if (arg == "--threads" && has_value) options.threads = std::stoul(argv[++i]);
+        else if (arg == "--input" && has_value) {
+            if (!loadScript(argv[++i], options.script)) {
+                std::cerr << "Could not read input script " << argv[i] << "\n";
+                std::exit(EXIT_FAILURE);
+            }
+        }
+        else if (arg == "--movie" && has_value) {
+            if (!movie.open(argv[++i])) {
+                std::cerr << "Could not read movie " << argv[i] << "\n";
+                std::exit(EXIT_FAILURE);
+            }
+            has_movie = true;
+        }
+        else if (arg == "--capture" && has_value) options.capture = argv[++i];
+        else if (arg == "--schip") options.machine = Machine::SuperChip;
+        else if (arg == "--xochip") options.machine = Machine::XoChip;
+        else if (arg == "--quirks" && has_value) options.quirks = argv[++i];
+        else if (arg == "--vip") options.vip = true;
+        else if (arg == "--jit") options.jit = true;
+        else if (arg == "--specialized") options.specialized = true;
+        else if (arg == "--aot") options.aot = true;
+        else if (arg == "--no-idle-skip") options.idle_skip = false;
+        else if (arg.rfind("--", 0) == 0) usage(argv[0]);
+        else options.roms.push_back(arg);
+    }
+    if (options.roms.empty()) usage(argv[0]);
+    if (options.vip) {
+        //Cycles still count instructions, as many frames as they'd take at --ipf
+        if (has_movie) {
+            std::cerr << "--movie replays a fixed instruction count per frame, it can't be combined with --vip\n";
+            std::exit(EXIT_FAILURE);
+        }
+        options.frames = frames ? frames : options.cycles / options.instructions_per_frame;
+    }
+    if (frames) {
+        options.cycles = frames * options.instructions_per_frame;
+        cycles_given = true;
+    }
+
+    //A movie replaces the script, seed, frame length, machine and quirks with the recorded ones
+    if (has_movie) {
+        const MovieHeader& header = movie.header();
+        options.script.clear();
+        for (const MovieEvent& event : movie.events()) options.script.push_back({event.cycle, event.key, event.pressed});
+
+        options.instructions_per_frame = header.instructions_per_frame;
+        options.first_seed = header.seed;
+        options.machine = static_cast<Machine>(header.machine);
+        if (header.quirks != MovieHeader::QUIRKS_UNKNOWN && header.quirks >= Quirks::COMBINATIONS) {
+            std::cerr << "Movie has unknown quirks " << header.quirks << "\n";
+            std::exit(EXIT_FAILURE);
+        }
+        options.seeds = 1;
+        if (!cycles_given) options.cycles = movie.cycles();
+        if (movie.complete()) options.movie_hash = movie.videoHash();
+        if (frames) options.cycles = frames * options.instructions_per_frame;
+    }
+
+    //Each ROM is read and validated once, jobs start from a copy of the prepared image
+    std::vector<Job> jobs;
+    for (const std::string& rom : options.roms) {
+        RomError error;
+        std::shared_ptr<const RomImage> image = RomCache::global().load(rom, &error);
+        if (!image) {
+            std::cerr << "Could not load " << rom << ": " << romErrorString(error) << "\n";
+            std::exit(EXIT_FAILURE);
+        }
+        if (has_movie && image->hash != movie.header().rom_hash) {
+            std::cerr << rom << " is not the ROM the movie was recorded with\n";
+            std::exit(EXIT_FAILURE);
+        }
+        if (image->size > MEM_SIZE - START_ADDRESS && options.machine != Machine::XoChip) {
+            std::cerr << "Could not load " << rom << ": programs over " << MEM_SIZE - START_ADDRESS << " bytes need --xochip\n";
+            std::exit(EXIT_FAILURE);
+        }
+
+        Quirks quirks = Quirks::defaults(options.machine);
+        bool parsed = options.quirks.empty() ? loadQuirksFile(rom, quirks) : parseQuirks(options.quirks, quirks);
+        if (!parsed) {
+            std::cerr << "Invalid quirks for " << rom << ", expected a list of vip, schip, xochip, shift-vy, load-store-increment, jump-vx, wrap, vf-reset\n";
+            std::exit(EXIT_FAILURE);
+        }
+        //Movies replay under the quirks they were recorded with, over the .quirks file; --quirks must agree
+        //Movies from before version 3 don't record them and keep the usual lookup
+        if (has_movie && movie.header().quirks != MovieHeader::QUIRKS_UNKNOWN) {
+            Quirks recorded = Quirks::fromBits(movie.header().quirks);
+            if (!options.quirks.empty() && quirks != recorded) {
+                std::cerr << "--quirks " << options.quirks << " differs from the quirks the movie was recorded with\n";
+                std::exit(EXIT_FAILURE);
+            }
+            quirks = recorded;
+        }
+        for (uint32_t seed = 0; seed < options.seeds; seed++) jobs.push_back({rom, image, options.first_seed + seed, quirks});
+    }
+
+    if (!options.capture.empty() && jobs.size() != 1) {
+        std::cerr << "--capture needs exactly one ROM and one seed\n";
+        std::exit(EXIT_FAILURE);
+    }
+    if (!options.capture.empty() && options.machine != Machine::Chip8) {
+        std::cerr << "--capture only records the 64x32 CHIP-8 display\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    //Results are printed in job order regardless of which worker finished first
+    std::vector<std::string> results(jobs.size());
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(options.threads);
+        for (size_t i = 0; i < jobs.size(); i++) {
+            pool.submit([&, i] { results[i] = runJob(jobs[i], options); });
+        }
+        pool.wait();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (const std::string& result : results) std::cout << result << "\n";
+    std::cerr << jobs.size() << " jobs in " << seconds << "s\n";
+
+    return 0;
+}
@@ -0,0 +1,355 @@
+#include "chip8.hpp"
+#include "lockstep.hpp"
+#include "vec_env.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//Core benchmark suite
+//Measures raw cycle() throughput, per-opcode loops on each engine and whole-ROM runs
+//with scripted input. Prints a table and optionally writes JSON for tracking across commits.
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options {
+    unsigned int reps = 5;
+    std::string json;
+    std::string filter;
+    std::string label;
+    std::string assets = "assets";
+};
+
+struct Result {
+    std::string name;
+    std::string engine;
+    uint64_t instructions;
+    double ns_mean;
+    double ns_stddev;
+    double ips_mean;
+};
+
+//A benchmark case: prepare() builds a fresh machine outside the timed region,
+//run() executes it and returns instructions executed
+struct Case {
+    std::string name;
+    std::function<void(Chip8&)> prepare;
+    std::function<uint64_t(Chip8&)> run;
+};
+
+const char* engineName(Engine engine) {
+    if (engine == Engine::Jit) return "jit";
+    return engine == Engine::Specialized ? "specialized" : "interpreter";
+}
+
+Result measure(const Case& bench, Engine engine, const Options& options) {
+    std::vector<double> ns_per_op;
+    uint64_t instructions = 0;
+
+    for (unsigned int rep = 0; rep < options.reps; rep++) {
+        std::unique_ptr<Chip8> chip8(new Chip8());
+        chip8->seed(rep);
+        bench.prepare(*chip8);
+        chip8->setEngine(engine);
+
+        auto start = Clock::now();
+        instructions = bench.run(*chip8);
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+        ns_per_op.push_back(ns / instructions);
+    }
+
+    double mean = 0;
+    for (double sample : ns_per_op) mean += sample;
+    mean /= ns_per_op.size();
+
+    double variance = 0;
+    for (double sample : ns_per_op) variance += (sample - mean) * (sample - mean);
+    variance /= ns_per_op.size() > 1 ? ns_per_op.size() - 1 : 1;
+
+    return {bench.name, engineName(engine), instructions, mean, std::sqrt(variance), 1e9 / mean};
+}
+
+//Program: setup opcodes once, then count copies of body followed by a jump back to the first copy
+std::vector<uint8_t> loopProgram(std::vector<uint16_t> setup, std::vector<uint16_t> body, unsigned int count) {
+    std::vector<uint16_t> words = setup;
+    uint16_t loop_start = START_ADDRESS + 2 * setup.size();
+
+    for (unsigned int i = 0; i < count; i++) words.insert(words.end(), body.begin(), body.end());
+    words.push_back(0x1000u | loop_start);
+
+    std::vector<uint8_t> bytes;
+    for (uint16_t word : words) {
+        bytes.push_back(word >> 8u);
+        bytes.push_back(word & 0xFFu);
+    }
+    return bytes;
+}
+
+std::vector<uint8_t> readFile(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+Case opcodeCase(const std::string& name, std::vector<uint16_t> setup, std::vector<uint16_t> body, uint64_t instructions) {
+    std::vector<uint8_t> program = loopProgram(setup, body, 255 / body.size());
+    return {
+        "op/" + name,
+        [program](Chip8& chip8) { chip8.loadRom(program.data(), program.size()); },
+        [instructions](Chip8& chip8) { return static_cast<uint64_t>(chip8.run(instructions)); }
+    };
+}
+
+Case opcodeCase(const std::string& name, std::vector<uint16_t> setup, uint16_t body, uint64_t instructions) {
+    return opcodeCase(name, setup, std::vector<uint16_t>{body}, instructions);
+}
+
+//Whole-ROM run at 10 instructions per frame, cycling through keys so games actually play
+Case romCase(const std::string& name, const std::vector<uint8_t>& rom, uint64_t frames) {
+    return {
+        "rom/" + name,
+        [rom](Chip8& chip8) { chip8.loadRom(rom.data(), rom.size()); },
+        [frames](Chip8& chip8) {
+            const uint8_t script[] = {0x4, 0x5, 0x6, 0x7, 0x5, 0x6};
+            uint64_t executed = 0;
+
+            for (uint64_t frame = 0; frame < frames; frame++) {
+                if (frame % 30 == 0) {
+                    memset(chip8.keypad, 0, sizeof(chip8.keypad));
+                    chip8.keypad[script[(frame / 30) % sizeof(script)]] = 1;
+                }
+                executed += chip8.run(10);
+                chip8.tickTimers();
+            }
+            return executed;
+        }
+    };
+}
+
+//Tree-search rollouts: forks a machine mid-game and plays each branch a few frames with its own key
+//ns/op includes the fork and the pages each branch copies when it writes memory or draws
+Case forkCase(const std::string& name, const std::vector<uint8_t>& rom, uint64_t rollouts) {
+    return {
+        "fork/" + name,
+        [rom](Chip8& chip8) {
+            chip8.loadRom(rom.data(), rom.size());
+            for (unsigned int frame = 0; frame < 600; frame++) {
+                chip8.run(10);
+                chip8.tickTimers();
+            }
+            chip8.seal();
+        },
+        [rollouts](Chip8& chip8) {
+            const uint8_t keys[] = {0x4, 0x5, 0x6, 0x7};
+            uint64_t executed = 0;
+
+            for (uint64_t rollout = 0; rollout < rollouts; rollout++) {
+                Chip8 branch(chip8);
+                branch.keypad[keys[rollout % sizeof(keys)]] = 1;
+                for (unsigned int frame = 0; frame < 10; frame++) {
+                    executed += branch.run(10);
+                    branch.tickTimers();
+                }
+            }
+            return executed;
+        }
+    };
+}
+
+//Training loop: 64 environments stepped 4 frames at a time with packed observations
+//ns/op includes building the environments, setting keys and writing observations every step
+Case vecCase(const std::string& name, const std::vector<uint8_t>& rom, unsigned int steps) {
+    std::shared_ptr<const RomImage> image = RomCache::global().load(rom.data(), rom.size());
+    return {
+        "vec/" + name,
+        [](Chip8&) {},
+        [image, steps](Chip8&) {
+            const unsigned int count = 64;
+            VecEnv env(*image, count);
+            std::vector<uint16_t> actions(count);
+            std::vector<float> rewards(count);
+            std::vector<uint8_t> dones(count);
+            std::vector<uint8_t> observations(count * env.observationSize());
+
+            env.reset(observations.data());
+            for (unsigned int step = 0; step < steps; step++) {
+                for (unsigned int i = 0; i < count; i++) actions[i] = 1u << (4 + (i + step / 8) % 4);
+                env.step(actions.data(), 4, rewards.data(), dones.data(), observations.data());
+            }
+            return env.instructionCount();
+        }
+    };
+}
+
+//64 machines on one program, one instruction at a time with a timer tick every 10
+//lanes/<name> runs them as LockstepChip8 lanes, lanes/<name>_scalar as separate Chip8s
+//calling cycle(), so the two compare the same work. Lanes are seeded differently and diverge
+std::vector<Case> laneCases(const std::string& name, const std::vector<uint8_t>& rom, uint64_t instructions) {
+    const unsigned int count = 64;
+    std::shared_ptr<const RomImage> image = RomCache::global().load(rom.data(), rom.size());
+    return {
+        {
+            "lanes/" + name,
+            [](Chip8&) {},
+            [image, instructions](Chip8&) {
+                LockstepChip8 lanes(count);
+                lanes.loadRom(*image);
+                for (unsigned int lane = 0; lane < count; lane++) lanes.seed(lane, lane);
+                for (uint64_t i = 0; i < instructions; i++) {
+                    lanes.cycle();
+                    if (i % 10 == 9) lanes.tickTimers();
+                }
+                return instructions * count;
+            }
+        },
+        {
+            "lanes/" + name + "_scalar",
+            [](Chip8&) {},
+            [image, instructions](Chip8&) {
+                std::vector<Chip8> machines(count);
+                for (unsigned int lane = 0; lane < count; lane++) {
+                    machines[lane].seed(lane);
+                    machines[lane].loadRom(*image);
+                }
+                for (uint64_t i = 0; i < instructions; i++) {
+                    for (Chip8& machine : machines) {
+                        machine.cycle();
+                        if (i % 10 == 9) machine.tickTimers();
+                    }
+                }
+                return instructions * count;
+            }
+        }
+    };
+}
+
+std::vector<Case> buildCases(const Options& options) {
+    const uint64_t ops = 2000000;
+    std::vector<Case> cases;
+
+    std::vector<uint8_t> tetris = readFile(options.assets + "/Tetris.ch8");
+    std::vector<uint8_t> test_opcode = readFile(options.assets + "/test_opcode.ch8");
+
+    //Raw cycle() calls, bypassing run()
+    cases.push_back({
+        "cycle/tetris",
+        [tetris](Chip8& chip8) { chip8.loadRom(tetris.data(), tetris.size()); },
+        [ops](Chip8& chip8) {
+            for (uint64_t i = 0; i < ops; i++) {
+                chip8.cycle();
+                if (i % 10 == 9) chip8.tickTimers();
+            }
+            return ops;
+        }
+    });
+
+    cases.push_back(opcodeCase("6xkk", {}, 0x6A12, ops));
+    cases.push_back(opcodeCase("7xkk", {}, 0x7A01, ops));
+    cases.push_back(opcodeCase("8xy4", {}, 0x8124, ops));
+    cases.push_back(opcodeCase("8xy6", {}, 0x8106, ops));
+    cases.push_back(opcodeCase("annn", {}, 0xA300, ops));
+    cases.push_back(opcodeCase("3xkk", {}, 0x3A01, ops));
+    cases.push_back(opcodeCase("00e0", {}, 0x00E0, ops));
+    //Dispatch through table F
+    cases.push_back(opcodeCase("fx07", {}, 0xF107, ops));
+    cases.push_back(opcodeCase("fx1e", {}, 0xF11E, ops));
+    cases.push_back(opcodeCase("fx29", {}, 0xF129, ops));
+    //x = F moves all 16 registers; I points away from code so no invalidation hits decoded code
+    cases.push_back(opcodeCase("fx55_xf", {0xAE00}, 0xFF55, ops));
+    cases.push_back(opcodeCase("fx65_xf", {0xAE00}, 0xFF65, ops));
+    //Draw font sprite at (0, 0) with increasing heights
+    cases.push_back(opcodeCase("dxyn_h1", {0xA050}, 0xD011, ops / 4));
+    cases.push_back(opcodeCase("dxyn_h5", {0xA050}, 0xD015, ops / 4));
+    cases.push_back(opcodeCase("dxyn_h15", {0xA050}, 0xD01F, ops / 4));
+    //Sequences the interpreter fuses into one dispatch
+    cases.push_back(opcodeCase("annn_dxyn", {}, {0xA050, 0xD015}, ops / 4));
+    cases.push_back(opcodeCase("fx07_3xkk", {}, {0xF107, 0x3101}, ops));
+    cases.push_back(opcodeCase("7xkk_3xkk", {}, {0x7A02, 0x3A01}, ops));
+
+    if (!tetris.empty()) cases.push_back(romCase("tetris", tetris, 60 * 600));
+    if (!test_opcode.empty()) cases.push_back(romCase("test_opcode", test_opcode, 60 * 600));
+    if (!tetris.empty()) cases.push_back(forkCase("tetris", tetris, 20000));
+    if (!tetris.empty()) cases.push_back(vecCase("tetris", tetris, 600));
+    if (!tetris.empty()) {
+        for (const Case& bench : laneCases("tetris", tetris, ops / 64)) cases.push_back(bench);
+    }
+    //Lanes never diverge here, every step takes the vector kernels
+    for (const Case& bench : laneCases("alu", loopProgram({}, {0xF107, 0x3101, 0x7A02, 0x3A01, 0xF11E, 0x8AB4}, 42), ops / 64)) {
+        cases.push_back(bench);
+    }
+
+    return cases;
+}
+
+void writeJson(const std::string& filename, const Options& options, const std::vector<Result>& results) {
+    FILE* file = fopen(filename.c_str(), "w");
+    if (!file) {
+        std::cerr << "Could not write " << filename << "\n";
+        return;
+    }
+
+    fprintf(file, "{\n  \"label\": \"%s\",\n  \"reps\": %u,\n  \"results\": [\n", options.label.c_str(), options.reps);
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& result = results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"engine\": \"%s\", \"instructions\": %llu, \"ns_per_op\": %.4f, \"ns_per_op_stddev\": %.4f, \"instructions_per_second\": %.0f}%s\n",
+            result.name.c_str(), result.engine.c_str(), static_cast<unsigned long long>(result.instructions),
+            result.ns_mean, result.ns_stddev, result.ips_mean, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+}
+
+void usage(const char* program) {
+    std::cerr << "Usage: " << program << " [--reps N] [--filter text] [--json file] [--label text] [--assets dir]\n";
+    std::exit(EXIT_FAILURE);
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--reps" && has_value) options.reps = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--filter" && has_value) options.filter = argv[++i];
+        else if (arg == "--json" && has_value) options.json = argv[++i];
+        else if (arg == "--label" && has_value) options.label = argv[++i];
+        else if (arg == "--assets" && has_value) options.assets = argv[++i];
+        else usage(argv[0]);
+    }
+
+    std::vector<Result> results;
+    printf("%-20s %-12s %12s %10s %14s\n", "benchmark", "engine", "ns/op", "stddev", "instr/s");
+
+    for (const Case& bench : buildCases(options)) {
+        if (!options.filter.empty() && bench.name.find(options.filter) == std::string::npos) continue;
+
+        //Raw cycle() is interpreter-only by definition, forks, environments and lanes run on the interpreter
+        std::vector<Engine> engines{Engine::Interpreter};
+        if (bench.name.rfind("cycle/", 0) != 0 && bench.name.rfind("fork/", 0) != 0 && bench.name.rfind("vec/", 0) != 0
+            && bench.name.rfind("lanes/", 0) != 0) {
+            engines.push_back(Engine::Jit);
+#ifdef CHIP8_SPECIALIZED
+            engines.push_back(Engine::Specialized);
+#endif
+        }
+
+        for (Engine engine : engines) {
+            Result result = measure(bench, engine, options);
+            printf("%-20s %-12s %12.3f %10.3f %14.0f\n", result.name.c_str(), result.engine.c_str(),
+                result.ns_mean, result.ns_stddev, result.ips_mean);
+            results.push_back(result);
+        }
+    }
+
+    if (!options.json.empty()) writeJson(options.json, options, results);
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include "capture.hpp"
+#include <cstring>
+
+namespace {
+
+const char delta_magic[4] = {'C', '8', 'F', 'D'};
+const uint32_t delta_version = 1;
+//Frames per batch before the writer is woken early
+const size_t batch_frames = 1024;
+//Y4M luma for lit and unlit pixels, chroma is neutral
+const uint8_t lit_luma = 235;
+const uint8_t unlit_luma = 16;
+
+void appendVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value) | 0x80u);
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void appendLittle(std::vector<uint8_t>& out, uint64_t value, unsigned int bytes) {
+    for (unsigned int i = 0; i < bytes; i++) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+}
+
+FrameCapture::~FrameCapture() {
+    close();
+}
+
+bool FrameCapture::open(const char* filename) {
+    size_t length = strlen(filename);
+    bool y4m = length >= 4 && strcmp(filename + length - 4, ".y4m") == 0;
+    return open(filename, y4m ? CaptureFormat::Y4M : CaptureFormat::Delta);
+}
+
+bool FrameCapture::open(const char* filename, CaptureFormat format) {
+    close();
+
+    file = fopen(filename, "wb");
+    if (!file) return false;
+    this->format = format;
+
+    if (format == CaptureFormat::Y4M) {
+        fprintf(file, "YUV4MPEG2 W%u H%u F60:1 Ip A1:1 C420jpeg\n", VIDEO_WIDTH, VIDEO_HEIGHT);
+    }
+    else {
+        std::vector<uint8_t> header(delta_magic, delta_magic + sizeof(delta_magic));
+        appendLittle(header, delta_version, 4);
+        appendLittle(header, VIDEO_WIDTH, 2);
+        appendLittle(header, VIDEO_HEIGHT, 2);
+        fwrite(header.data(), 1, header.size(), file);
+    }
+
+    closing = false;
+    has_last = false;
+    has_written = false;
+    submitted = 0;
+    queued = 0;
+    writer = std::thread(&FrameCapture::writerLoop, this);
+    return true;
+}
+
+bool FrameCapture::isOpen() const {
+    return file != nullptr;
+}
+
+void FrameCapture::submit(const uint64_t* video, uint64_t frame) {
+    if (!file) return;
+    submitted++;
+    last_frame = frame;
+
+    if (has_last && memcmp(last_video, video, sizeof(last_video)) == 0) return;
+    memcpy(last_video, video, sizeof(last_video));
+    has_last = true;
+    last_queued_frame = frame;
+    queued++;
+
+    QueuedFrame queued_frame;
+    queued_frame.frame = frame;
+    memcpy(queued_frame.video, video, sizeof(queued_frame.video));
+
+    bool wake;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        filling.push_back(queued_frame);
+        wake = filling.size() == batch_frames;
+    }
+    if (wake) batch_ready.notify_one();
+}
+
+void FrameCapture::close() {
+    if (!file) return;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        //Y4M has no timestamps, so an unchanged tail is written out to keep the full length
+        if (format == CaptureFormat::Y4M && has_last && last_frame > last_queued_frame) {
+            QueuedFrame tail;
+            tail.frame = last_frame;
+            memcpy(tail.video, last_video, sizeof(tail.video));
+            filling.push_back(tail);
+        }
+        closing = true;
+    }
+    batch_ready.notify_one();
+    writer.join();
+
+    fclose(file);
+    file = nullptr;
+}
+
+uint64_t FrameCapture::framesSubmitted() const {
+    return submitted;
+}
+
+uint64_t FrameCapture::framesQueued() const {
+    return queued;
+}
+
+//Swaps the filled batch for the empty one, then encodes and writes it outside the lock
+void FrameCapture::writerLoop() {
+    while (true) {
+        bool last;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            batch_ready.wait_for(guard, std::chrono::milliseconds(100), [this] {
+                return closing || filling.size() >= batch_frames;
+            });
+            writing.swap(filling);
+            last = closing;
+        }
+
+        out.clear();
+        for (const QueuedFrame& queued_frame : writing) encode(queued_frame);
+        writing.clear();
+
+        if (!out.empty()) fwrite(out.data(), 1, out.size(), file);
+        if (last) break;
+    }
+}
+
+void FrameCapture::encode(const QueuedFrame& queued_frame) {
+    if (format == CaptureFormat::Y4M) {
+        //Repeat the previous picture for frames dropped as unchanged, so timing is preserved
+        if (has_written) {
+            for (uint64_t frame = written_frame + 1; frame < queued_frame.frame; frame++) encodeY4M(written_video);
+        }
+        encodeY4M(queued_frame.video);
+    }
+    else {
+        appendVarint(out, has_written ? queued_frame.frame - written_frame : queued_frame.frame);
+
+        uint32_t changed_rows = 0;
+        for (unsigned int row = 0; row < VIDEO_HEIGHT; row++) {
+            if (queued_frame.video[row] != written_video[row]) changed_rows |= 1u << row;
+        }
+        appendLittle(out, changed_rows, 4);
+
+        for (unsigned int row = 0; row < VIDEO_HEIGHT; row++) {
+            if (!(changed_rows & (1u << row))) continue;
+
+            //Byte 0 is the leftmost 8 pixels
+            uint64_t diff = queued_frame.video[row] ^ written_video[row];
+            uint8_t byte_mask = 0;
+            for (unsigned int byte = 0; byte < 8; byte++) {
+                if ((diff >> (56 - 8 * byte)) & 0xFFu) byte_mask |= 1u << byte;
+            }
+            out.push_back(byte_mask);
+            for (unsigned int byte = 0; byte < 8; byte++) {
+                if (byte_mask & (1u << byte)) out.push_back(static_cast<uint8_t>(diff >> (56 - 8 * byte)));
+            }
+        }
+    }
+
+    memcpy(written_video, queued_frame.video, sizeof(written_video));
+    written_frame = queued_frame.frame;
+    has_written = true;
+}
+
+void FrameCapture::encodeY4M(const uint64_t* video) {
+    const char frame_header[] = "FRAME\n";
+    out.insert(out.end(), frame_header, frame_header + sizeof(frame_header) - 1);
+
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; y++) {
+        for (unsigned int x = 0; x < VIDEO_WIDTH; x++) {
+            out.push_back((video[y] >> (63 - x)) & 1u ? lit_luma : unlit_luma);
+        }
+    }
+    out.insert(out.end(), VIDEO_WIDTH * VIDEO_HEIGHT / 2, 128);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "chip8.hpp"
+
+//Headless frame capture to disk
+//Y4M:   raw 4:2:0 video at 60 fps, playable by ffmpeg/mpv; frames the emulator skipped as
+//       unchanged are repeated by the writer so playback keeps real time
+//Delta: "C8FD", u32 version, u16 width, u16 height, then one record per changed frame:
+//       varint frame number delta, u32 mask of changed rows, and for each changed row
+//       a byte mask of changed bytes followed by those bytes XORed with the previous frame
+enum class CaptureFormat {
+    Y4M,
+    Delta
+};
+
+//Frames are queued as packed rows and encoded and written in batches on a writer thread,
+//so submit() costs a 256 byte compare and copy. The emulator never waits for the disk:
+//while the writer is busy the next batch keeps growing.
+class FrameCapture {
+    public:
+        FrameCapture() = default;
+        ~FrameCapture();
+
+        FrameCapture(const FrameCapture&) = delete;
+        FrameCapture& operator=(const FrameCapture&) = delete;
+
+        bool open(const char* filename, CaptureFormat format);
+        //Format from the file name: .y4m is Y4M, anything else is Delta
+        bool open(const char* filename);
+        bool isOpen() const;
+
+        //Frame numbers must increase; frames identical to the last submitted one are dropped
+        void submit(const uint64_t* video, uint64_t frame);
+        //Writes everything queued and closes the file
+        void close();
+
+        uint64_t framesSubmitted() const;
+        uint64_t framesQueued() const;
+
+    private:
+        struct QueuedFrame {
+            uint64_t frame;
+            uint64_t video[VIDEO_HEIGHT];
+        };
+
+        FILE* file{};
+        CaptureFormat format{CaptureFormat::Delta};
+        std::thread writer;
+
+        std::mutex lock;
+        std::condition_variable batch_ready;
+        std::vector<QueuedFrame> filling;
+        bool closing{};
+
+        //Producer side
+        uint64_t last_video[VIDEO_HEIGHT]{};
+        bool has_last{};
+        uint64_t last_frame{};
+        uint64_t last_queued_frame{};
+        uint64_t submitted{};
+        uint64_t queued{};
+
+        //Writer side
+        std::vector<QueuedFrame> writing;
+        std::vector<uint8_t> out;
+        uint64_t written_video[VIDEO_HEIGHT]{};
+        uint64_t written_frame{};
+        bool has_written{};
+
+        void writerLoop();
+        void encode(const QueuedFrame& queued_frame);
+        void encodeY4M(const uint64_t* video);
+};
@@ -1,10 +1,14 @@
 #include "chip8.hpp"
+#include "jit.hpp"
+#include "rom.hpp"
+#include "specialized.hpp"
+#include "aot.hpp"
+#include "arena.hpp"
+#include <algorithm>
+#include <new>
 
 
-    const unsigned int start_address = 0x200;
-    const unsigned int fontset_start_address = 0x50;
-    const unsigned int fontset_size = 80;
-    uint8_t fontset[fontset_size] =
+    const uint8_t FONTSET[FONTSET_SIZE] =
     {
 	0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
 	0x20, 0x60, 0x20, 0x20, 0x70, // 1
@@ -24,160 +28,1092 @@
 	0xF0, 0x80, 0xF0, 0x80, 0x80  // F
     };
 
-Chip8::Chip8()
-    //Seeding random value
-    :r(std::chrono::system_clock::now().time_since_epoch().count()) {
+    //SCHIP 8x10 digits, XO-CHIP adds A-F
+    const uint8_t BIG_FONTSET[BIG_FONTSET_SIZE] =
+    {
+	0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+	0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+	0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+	0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+	0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+	0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+	0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+	0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+	0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+	0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+	0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+	0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+    };
+
+namespace {
+
+//One arena per shared block type, used by every machine
+template<typename Block>
+Arena& arena() {
+    static Arena blocks(sizeof(Block), 64);
+    return blocks;
+}
+
+//Zeroed block with one reference
+template<typename Block>
+Block* allocate() {
+    Block* block = new (arena<Block>().allocate()) Block();
+    block->references.store(1, std::memory_order_relaxed);
+    return block;
+}
+
+template<typename Block>
+Block* share(Block* block) {
+    block->references.fetch_add(1, std::memory_order_relaxed);
+    return block;
+}
+
+//Drops a reference, returns true if it was the last and the block is gone
+template<typename Block>
+bool release(Block* block) {
+    if (!block || block->references.fetch_sub(1, std::memory_order_acq_rel) != 1) return false;
+    block->~Block();
+    arena<Block>().release(block);
+    return true;
+}
+
+//Block about to be written: a shared one is replaced by a private copy
+template<typename Block>
+bool own(Block*& block) {
+    if (block->references.load(std::memory_order_acquire) == 1) return false;
+    Block* copy = allocate<Block>();
+    copy->data = block->data;
+    release(block);
+    block = copy;
+    return true;
+}
+
+}
+
+Chip8::Chip8() {
+    //Seeding random value, seed() makes runs reproducible
+    rng.seed(std::chrono::system_clock::now().time_since_epoch().count());
+
+    //Allocates memory, loads the fontset and picks the decode tables
+    setMachine(Machine::Chip8);
+}
+
+Chip8::Chip8(const Chip8& other) {
+    *this = other;
+}
+
+//Shares the storage and copies the rest, about 200 bytes of CPU and tracking state
+Chip8& Chip8::operator=(const Chip8& other) {
+    if (this == &other) return *this;
+
+    jit.reset();
+    aot.reset();
+    releaseStorage();
+    page_table = share(other.page_table);
+    memcpy(pages, other.pages, page_table->data.count * sizeof(pages[0]));
+    video_page = share(other.video_page);
+    wide_video_page = share(other.wide_video_page);
+    video = video_page->data.rows;
+    xvideo = wide_video_page->data.planes;
+    memcpy(unsealed, other.unsealed, sizeof(unsealed));
+    //Pending decodes would otherwise be written into pages both machines share, so pages the
+    //source hasn't sealed are copied now. The source is only read, see seal()
+    for (unsigned int index = 0; index < page_table->data.count; index++) {
+        if (unsealed[index / 64] & (1ull << (index % 64))) ownPage(index);
+    }
+
+    memcpy(keypad, other.keypad, sizeof(keypad));
+    memcpy(registers, other.registers, sizeof(registers));
+    memcpy(stack, other.stack, sizeof(stack));
+    memcpy(flags, other.flags, sizeof(flags));
+    memcpy(audio_pattern, other.audio_pattern, sizeof(audio_pattern));
+    memory_mask = other.memory_mask;
+    memory_index = other.memory_index;
+    program_counter = other.program_counter;
+    stack_pointer = other.stack_pointer;
+    delay_timer = other.delay_timer;
+    sound_timer = other.sound_timer;
+    inst = nullptr;
+    specialized = other.specialized;
+#ifdef CHIP8_PROFILE
+    profile = other.profile;
+#endif
+    machine = other.machine;
+    hires = other.hires;
+    plane_mask = other.plane_mask;
+    pitch = other.pitch;
+    quirks = other.quirks;
+    idle_skip = other.idle_skip;
+    display_wait = other.display_wait;
+    vblank_wait = other.vblank_wait;
+    observed_keys = other.observed_keys;
+    idle_skipped = other.idle_skipped;
+    dirty_rows = other.dirty_rows;
+    dirty_pages = other.dirty_pages;
+    page_shift = other.page_shift;
+    rng = other.rng;
+    tables = other.tables;
+    return *this;
+}
+
+void Chip8::restartFrom(const Chip8& source) {
+    if (this == &source) return;
+
+    Engine engine = getEngine();
+    std::unique_ptr<Jit> kept = std::move(jit);
+    *this = source;
+    //Blocks call into decoded entries of the pages just released
+    if (kept) kept->flush();
+    jit = std::move(kept);
+    setEngine(engine);
+}
+
+//The last machine using a page table releases its pages too
+void Chip8::releaseTable(Shared<PageTable>* table) {
+    if (!table || table->references.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    for (unsigned int i = 0; i < table->data.count; i++) release(table->data.pages[i]);
+    table->~Shared<PageTable>();
+    arena<Shared<PageTable>>().release(table);
+}
+
+void Chip8::releaseStorage() {
+    releaseTable(page_table);
+    release(video_page);
+    release(wide_video_page);
+    page_table = nullptr;
+    video_page = nullptr;
+    wide_video_page = nullptr;
+}
+
+Chip8::Shared<Chip8::MemoryPage>* Chip8::ownPage(unsigned int index) {
+    if (page_table->references.load(std::memory_order_acquire) != 1) {
+        //Copying the table adds a reference to every page it lists
+        Shared<PageTable>* copy = allocate<Shared<PageTable>>();
+        copy->data = page_table->data;
+        for (unsigned int i = 0; i < copy->data.count; i++) share(copy->data.pages[i]);
+        releaseTable(page_table);
+        page_table = copy;
+    }
+
+    //Compiled blocks point at decoded entries, which just moved
+    Shared<MemoryPage>*& page = page_table->data.pages[index];
+    if (own(page)) {
+        pages[index] = page;
+        if (jit) jit->invalidate(index << MEMORY_PAGE_SHIFT, MEMORY_PAGE_SIZE);
+    }
+    return page;
+}
+
+uint64_t* Chip8::ownVideo() {
+    own(video_page);
+    video = video_page->data.rows;
+    return video_page->data.rows;
+}
+
+uint64_t (*Chip8::ownWideVideo())[HIRES_HEIGHT][2] {
+    own(wide_video_page);
+    xvideo = wide_video_page->data.planes;
+    return wide_video_page->data.planes;
+}
+
+//Decoding reads up to MAX_FUSED instructions ahead, into the next page. That page is either
+//decoded there already or unsealed itself, so it is never a shared page
+void Chip8::seal() {
+    for (unsigned int index = 0; index < page_table->data.count; index++) {
+        if (!(unsealed[index / 64] & (1ull << (index % 64)))) continue;
+
+        Shared<MemoryPage>* page = pages[index];
+        for (unsigned int offset = 0; offset < MEMORY_PAGE_SIZE; offset++) {
+            Instruction& entry = page->data.decoded[offset];
+            if (entry.handler == OP_DECODE) decode(entry, (index << MEMORY_PAGE_SHIFT) | offset);
+        }
+        unsealed[index / 64] &= ~(1ull << (index % 64));
+    }
+}
+
+void Chip8::dropDecodes() {
+    for (unsigned int index = 0; index < page_table->data.count; index++) {
+        Instruction* entries = ownPage(index)->data.decoded;
+        for (unsigned int offset = 0; offset < MEMORY_PAGE_SIZE; offset++) {
+            entries[offset].handler = OP_DECODE;
+            entries[offset].base = OP_DECODE;
+            entries[offset].length = 1;
+        }
+    }
+    memset(unsealed, 0xFF, sizeof(unsealed));
+    if (jit) jit->flush();
+}
+
+void Chip8::readBlock(uint16_t address, uint8_t* out, size_t size) const {
+    for (size_t i = 0; i < size;) {
+        unsigned int at = (address + i) & memory_mask;
+        size_t chunk = std::min<size_t>(size - i, MEMORY_PAGE_SIZE - (at & (MEMORY_PAGE_SIZE - 1)));
+        memcpy(out + i, &pages[at >> MEMORY_PAGE_SHIFT]->data.bytes[at & (MEMORY_PAGE_SIZE - 1)], chunk);
+        i += chunk;
+    }
+}
+
+void Chip8::writeBlock(uint16_t address, const uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size;) {
+        unsigned int at = (address + i) & memory_mask;
+        size_t chunk = std::min<size_t>(size - i, MEMORY_PAGE_SIZE - (at & (MEMORY_PAGE_SIZE - 1)));
+        uint8_t* bytes = &ownPage(at >> MEMORY_PAGE_SHIFT)->data.bytes[at & (MEMORY_PAGE_SIZE - 1)];
+        for (size_t j = 0; j < chunk; j++) bytes[j] = data[i + j];
+        i += chunk;
+    }
+    invalidate(address, size);
+}
+
+//Resets the machine for an instruction set
+//Memory and display are replaced by fresh pages, so the JIT (which points into them) is dropped
+//Copies of this machine keep the old ones
+void Chip8::setMachine(Machine selected) {
+    jit.reset();
+    specialized = false;
+    aot.reset();
+
+    machine = selected;
+    unsigned int size = machine == Machine::XoChip ? XO_MEM_SIZE : MEM_SIZE;
+    releaseStorage();
+    page_table = allocate<Shared<PageTable>>();
+    page_table->data.count = size >> MEMORY_PAGE_SHIFT;
+    for (unsigned int i = 0; i < page_table->data.count; i++) page_table->data.pages[i] = allocate<Shared<MemoryPage>>();
+    memcpy(pages, page_table->data.pages, page_table->data.count * sizeof(pages[0]));
+    memset(unsealed, 0xFF, sizeof(unsealed));
+    video_page = allocate<Shared<VideoPage>>();
+    wide_video_page = allocate<Shared<WideVideoPage>>();
+    video = video_page->data.rows;
+    xvideo = wide_video_page->data.planes;
+    memory_mask = size - 1;
+    page_shift = machine == Machine::XoChip ? 10 : 6;
+    dirty_pages = ~0ull;
+    quirks = Quirks::defaults(machine);
+    tables = &decodeTables(machine, quirks);
+    vblank_wait = false;
+
+    //Loading fontsets into memory
+    writeBlock(FONTSET_START_ADDRESS, FONTSET, FONTSET_SIZE);
+    if (machine != Machine::Chip8) writeBlock(BIG_FONTSET_START_ADDRESS, BIG_FONTSET, BIG_FONTSET_SIZE);
 
     //Initializing program counter to first unreserved byte 0x200
-    program_counter = start_address;
+    program_counter = START_ADDRESS;
+    memset(registers, 0, sizeof(registers));
+    memset(stack, 0, sizeof(stack));
+    memory_index = 0;
+    stack_pointer = 0;
+    delay_timer = 0;
+    sound_timer = 0;
+
+    hires = false;
+    plane_mask = 1;
+    memset(audio_pattern, 0, sizeof(audio_pattern));
+    pitch = 64;
+    dirty_rows = 0xFFFFFFFFu;
+}
+
+Machine Chip8::getMachine() const {
+    return machine;
+}
+
+unsigned int Chip8::displayWidth() const {
+    return machine == Machine::Chip8 ? VIDEO_WIDTH : HIRES_WIDTH;
+}
+
+unsigned int Chip8::displayHeight() const {
+    return machine == Machine::Chip8 ? VIDEO_HEIGHT : HIRES_HEIGHT;
+}
 
-    //Initializing RNG seed
-    rand_byte = std::uniform_int_distribution<uint8_t>(0, 255U);
+uint64_t Chip8::hashDisplay() const {
+    if (machine == Machine::Chip8) return hashRows(video, VIDEO_HEIGHT);
+    return hashRows(&xvideo[0][0][0], PLANE_COUNT * HIRES_HEIGHT * 2);
+}
+
+Quirks Quirks::defaults(Machine machine) {
+    Quirks quirks;
+    //Octo, the reference XO-CHIP implementation, wraps sprites
+    quirks.wrap = machine == Machine::XoChip;
+    return quirks;
+}
+
+unsigned int Quirks::bits() const {
+    return shift_vy | load_store_increment << 1 | jump_vx << 2 | wrap << 3 | vf_reset << 4;
+}
 
-    //Loading fontset into memory
-    for (unsigned int i = 0; i < fontset_size; i++) {
-        memory[fontset_start_address + i] = fontset[i];
+Quirks Quirks::fromBits(unsigned int bits) {
+    Quirks quirks;
+    quirks.shift_vy = bits & 1u;
+    quirks.load_store_increment = bits & 2u;
+    quirks.jump_vx = bits & 4u;
+    quirks.wrap = bits & 8u;
+    quirks.vf_reset = bits & 16u;
+    return quirks;
+}
+
+bool parseQuirks(const std::string& text, Quirks& quirks) {
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = std::min(text.find(',', start), text.size());
+        std::string name = text.substr(start, end - start);
+        start = end + 1;
+
+        if (name.empty()) continue;
+        bool value = name.rfind("no-", 0) != 0;
+        if (!value) name = name.substr(3);
+
+        //Profiles: the original COSMAC VIP interpreter, SCHIP 1.1 and Octo
+        if (name == "vip") quirks = {true, true, false, false, true};
+        else if (name == "schip") quirks = {false, false, true, false, false};
+        else if (name == "xochip") quirks = {true, true, false, true, false};
+        else if (name == "shift-vy") quirks.shift_vy = value;
+        else if (name == "load-store-increment") quirks.load_store_increment = value;
+        else if (name == "jump-vx") quirks.jump_vx = value;
+        else if (name == "wrap") quirks.wrap = value;
+        else if (name == "vf-reset") quirks.vf_reset = value;
+        else return false;
     }
-    
-    //Filling master function pointer table
-    table[0x0] = &Chip8::Table0;
-    table[0x1] = &Chip8::op_1nnn;
-    table[0x2] = &Chip8::op_2nnn;
-    table[0x3] = &Chip8::op_3xkk;
-    table[0x4] = &Chip8::op_4xkk;
-    table[0x5] = &Chip8::op_5xy0;
-    table[0x6] = &Chip8::op_6xkk;
-    table[0x7] = &Chip8::op_7xkk;
-    table[0x8] = &Chip8::Table8;
-    table[0x9] = &Chip8::op_9xy0;
-    table[0xA] = &Chip8::op_annn;
-    table[0xB] = &Chip8::op_bnnn;
-    table[0xC] = &Chip8::op_cxkk;
-    table[0xD] = &Chip8::op_dxyn;
-    table[0xE] = &Chip8::TableE;
-    table[0xF] = &Chip8::TableF;
-
-    //Filling size 15 pointer tables (0, 8, E) w/ op_null pointers for invalid operands
-    for (size_t i = 0; i < 0xE; i++) {
-        table0[i] = &Chip8::op_null;
-        table8[i] = &Chip8::op_null;
-        tableE[i] = &Chip8::op_null;
-    }
-
-    //Filling function pointer tables 0, 8, E
-    table0[0x0] = &Chip8::op_00e0;
-    table0[0xE] = &Chip8::op_00ee;
-
-    table8[0x0] = &Chip8::op_8xy0;
-    table8[0x1] = &Chip8::op_8xy1;
-    table8[0x2] = &Chip8::op_8xy2;
-    table8[0x3] = &Chip8::op_8xy3;
-    table8[0x4] = &Chip8::op_8xy4;
-    table8[0x5] = &Chip8::op_8xy5;
-    table8[0x6] = &Chip8::op_8xy6;
-    table8[0x7] = &Chip8::op_8xy7;
-    table8[0xE] = &Chip8::op_8xye;
-
-    tableE[0x1] = &Chip8::op_exa1;
-    tableE[0xE] = &Chip8::op_ex9e;
-
-    //Filling F pointer table w/ op_null pointers for invalid operands
-    for (size_t i = 0; i < 0x65; i++) {
-        tableF[i] = &Chip8::op_null;
-    }
-
-    //Filling pointer table F
-    tableF[0x07] = &Chip8::op_fx07;
-    tableF[0x0A] = &Chip8::op_fx0a;
-    tableF[0x15] = &Chip8::op_fx15;
-    tableF[0x18] = &Chip8::op_fx18;
-    tableF[0x1E] = &Chip8::op_fx1e;
-    tableF[0x29] = &Chip8::op_fx29;
-    tableF[0x33] = &Chip8::op_fx33;
-    tableF[0x55] = &Chip8::op_fx55;
-    tableF[0x65] = &Chip8::op_fx65;
-}
-
-//Function pointer loaders
-//Runs operation from given pointer table based on opcode
-//Ex: 81A0 -> table0[81A0 & 000Fu] -> table8[0000] -> op_8xy0() (LD V1, VA)
-//Ex: 00E3 -> table0[00E3 & 000Fu] -> table0[0003] -> op_null() (Do nothing)
-void Chip8::Table0() {
-    ( (*this).*(table0[opcode & 0x000Fu]) )();
-}
-
-void Chip8::Table8() {
-    ( (*this).*(table8[opcode & 0x000Fu]) )();
-}
-
-void Chip8::TableE() {
-    ( (*this).*(tableE[opcode & 0x000Fu]) )();
-}
-
-void Chip8:: TableF() {
-    ( (*this).*(tableF[opcode & 0x000Fu]) )();
+    return true;
+}
+
+//Every instruction set with every quirk set, about 55 KB built on first use
+const Chip8::DecodeTables& Chip8::decodeTables(Machine machine, const Quirks& quirks) {
+    static const std::vector<DecodeTables> built = [] {
+        std::vector<DecodeTables> tables(3 * Quirks::COMBINATIONS);
+        for (unsigned int i = 0; i < tables.size(); i++) {
+            Quirks set;
+            unsigned int bits = i % Quirks::COMBINATIONS;
+            set.shift_vy = bits & 1u;
+            set.load_store_increment = bits & 2u;
+            set.jump_vx = bits & 4u;
+            set.wrap = bits & 8u;
+            set.vf_reset = bits & 16u;
+            tables[i].build(static_cast<Machine>(i / Quirks::COMBINATIONS), set);
+        }
+        return tables;
+    }();
+    return built[static_cast<unsigned int>(machine) * Quirks::COMBINATIONS + quirks.bits()];
+}
+
+void Chip8::DecodeTables::build(Machine machine, const Quirks& quirks) {
+    bool extended = machine != Machine::Chip8;
+    bool xo = machine == Machine::XoChip;
+
+    //Filling master decode table
+    //Families 0, 5, 8, E and F are resolved through their own tables in decode()
+    table[0x0] = OP_NULL;
+    table[0x1] = OP_1NNN;
+    table[0x2] = OP_2NNN;
+    table[0x3] = OP_3XKK;
+    table[0x4] = OP_4XKK;
+    table[0x5] = OP_NULL;
+    table[0x6] = OP_6XKK;
+    table[0x7] = OP_7XKK;
+    table[0x8] = OP_NULL;
+    table[0x9] = OP_9XY0;
+    table[0xA] = OP_ANNN;
+    table[0xB] = quirks.jump_vx ? OP_BXNN : OP_BNNN;
+    table[0xC] = OP_CXKK;
+    if (extended) table[0xD] = quirks.wrap ? OP_DXYN_WIDE_WRAP : OP_DXYN_WIDE;
+    else table[0xD] = quirks.wrap ? OP_DXYN_WRAP : OP_DXYN;
+    table[0xE] = OP_NULL;
+    table[0xF] = OP_NULL;
+
+    //Filling size 16 decode tables (8, E) w/ op_null for invalid operands
+    //Every 5xyn is SE Vx, Vy unless XO-CHIP claims it
+    for (size_t i = 0; i <= 0xF; i++) {
+        table5[i] = OP_5XY0;
+        table8[i] = OP_NULL;
+        tableE[i] = OP_NULL;
+    }
+
+    //Filling size 256 decode tables (0, F) w/ op_null for invalid operands
+    //CHIP-8 only looks at the last nibble of 0nnn, so any 0xy0 clears and any 0xyE returns
+    for (size_t i = 0; i <= 0xFF; i++) {
+        table0[i] = OP_NULL;
+        if (!extended && (i & 0xFu) == 0x0) table0[i] = OP_00E0;
+        if (!extended && (i & 0xFu) == 0xE) table0[i] = OP_00EE;
+        tableF[i] = OP_NULL;
+    }
+
+    //Filling decode tables 0, 5, 8, E
+    table0[0xE0] = OP_00E0;
+    table0[0xEE] = OP_00EE;
+    if (extended) {
+        for (size_t n = 0; n <= 0xF; n++) {
+            table0[0xC0 | n] = OP_00CN;
+            if (xo) table0[0xD0 | n] = OP_00DN;
+        }
+        table0[0xFB] = OP_00FB;
+        table0[0xFC] = OP_00FC;
+        table0[0xFD] = OP_00FD;
+        table0[0xFE] = OP_00FE;
+        table0[0xFF] = OP_00FF;
+    }
+
+    if (xo) {
+        table5[0x2] = OP_5XY2;
+        table5[0x3] = OP_5XY3;
+    }
+
+    table8[0x0] = OP_8XY0;
+    table8[0x1] = quirks.vf_reset ? OP_8XY1_VF : OP_8XY1;
+    table8[0x2] = quirks.vf_reset ? OP_8XY2_VF : OP_8XY2;
+    table8[0x3] = quirks.vf_reset ? OP_8XY3_VF : OP_8XY3;
+    table8[0x4] = OP_8XY4;
+    table8[0x5] = OP_8XY5;
+    table8[0x6] = quirks.shift_vy ? OP_8XY6_VY : OP_8XY6;
+    table8[0x7] = OP_8XY7;
+    table8[0xE] = quirks.shift_vy ? OP_8XYE_VY : OP_8XYE;
+
+    tableE[0x1] = OP_EXA1;
+    tableE[0xE] = OP_EX9E;
+
+    //Filling decode table F
+    tableF[0x07] = OP_FX07;
+    tableF[0x0A] = OP_FX0A;
+    tableF[0x15] = OP_FX15;
+    tableF[0x18] = OP_FX18;
+    tableF[0x1E] = OP_FX1E;
+    tableF[0x29] = OP_FX29;
+    tableF[0x33] = OP_FX33;
+    tableF[0x55] = quirks.load_store_increment ? OP_FX55_I : OP_FX55;
+    tableF[0x65] = quirks.load_store_increment ? OP_FX65_I : OP_FX65;
+    if (extended) {
+        tableF[0x30] = OP_FX30;
+        tableF[0x75] = OP_FX75;
+        tableF[0x85] = OP_FX85;
+    }
+    if (xo) {
+        tableF[0x00] = OP_F000;
+        tableF[0x01] = OP_FN01;
+        tableF[0x02] = OP_F002;
+        tableF[0x3A] = OP_FX3A;
+    }
+}
+
+Chip8::~Chip8() {
+    //Compiled code goes first, it points into the pages
+    jit.reset();
+    aot.reset();
+    releaseStorage();
+}
+
+//Handler table, in the same order as the Handler enum
+const Chip8::Chip8Func Chip8::handlers[] = {
+    &Chip8::op_decode,
+    &Chip8::op_00e0, &Chip8::op_00ee, &Chip8::op_1nnn, &Chip8::op_2nnn,
+    &Chip8::op_3xkk, &Chip8::op_4xkk, &Chip8::op_5xy0, &Chip8::op_6xkk,
+    &Chip8::op_7xkk, &Chip8::op_8xy0, &Chip8::op_8xy1<false>, &Chip8::op_8xy2<false>,
+    &Chip8::op_8xy3<false>, &Chip8::op_8xy4, &Chip8::op_8xy5, &Chip8::op_8xy6<false>,
+    &Chip8::op_8xy7, &Chip8::op_8xye<false>, &Chip8::op_9xy0, &Chip8::op_annn,
+    &Chip8::op_bnnn<false>, &Chip8::op_cxkk, &Chip8::op_dxyn<DrawMode::Clip>, &Chip8::op_ex9e,
+    &Chip8::op_exa1, &Chip8::op_fx07, &Chip8::op_fx0a, &Chip8::op_fx15,
+    &Chip8::op_fx18, &Chip8::op_fx1e, &Chip8::op_fx29, &Chip8::op_fx33,
+    &Chip8::op_fx55<false>, &Chip8::op_fx65<false>,
+    &Chip8::op_00cn, &Chip8::op_00dn, &Chip8::op_00fb, &Chip8::op_00fc,
+    &Chip8::op_00fd, &Chip8::op_00fe, &Chip8::op_00ff, &Chip8::op_5xy2,
+    &Chip8::op_5xy3, &Chip8::op_dxyn_wide<DrawMode::Clip>, &Chip8::op_f000, &Chip8::op_fn01,
+    &Chip8::op_f002, &Chip8::op_fx30, &Chip8::op_fx3a, &Chip8::op_fx75,
+    &Chip8::op_fx85,
+    &Chip8::op_8xy1<true>, &Chip8::op_8xy2<true>, &Chip8::op_8xy3<true>, &Chip8::op_8xy6<true>,
+    &Chip8::op_8xye<true>, &Chip8::op_bnnn<true>, &Chip8::op_fx55<true>, &Chip8::op_fx65<true>,
+    &Chip8::op_dxyn<DrawMode::Wrap>, &Chip8::op_dxyn_wide<DrawMode::Wrap>,
+    &Chip8::op_annn_dxyn, &Chip8::op_6xkk_run, &Chip8::op_fx07_3xkk, &Chip8::op_7xkk_3xkk,
+    &Chip8::op_null
+};
+
+//COSMAC VIP cost of each handler in machine cycles, fetch and decode included, in the same order
+//as the Handler enum. Averages from measurements of the VIP interpreter's routines (about 4.5 us
+//per cycle). Later instructions don't exist on the VIP and cost as much as their nearest VIP
+//routine, fused sequences are costed one instruction at a time by their base handler
+const uint16_t Chip8::vip_cycles[] = {
+    0,
+    24, 23, 23, 23, 12, 12, 16, 6,
+    10, 44, 44, 44, 44, 44, 44, 44,
+    44, 44, 16, 12, 23, 36, 0, 16,
+    16, 10, 10, 10, 10, 19, 20, 204,
+    0, 0,
+    100, 100, 100, 100, 23, 24, 24, 0,
+    0, 0, 12, 6, 0, 20, 10, 0,
+    0,
+    44, 44, 44, 44, 44, 23, 0, 0,
+    0, 0,
+    0, 0, 0, 0,
+    23
+};
+
+//Decoder
+//Fetches opcode at address, extracts operands and resolves handler through decode tables
+//Ex: 81A0 -> table8[81A0 & 000Fu] -> table8[0000] -> OP_8XY0 (LD V1, VA)
+//Ex: F165 -> tableF[F165 & 00FFu] -> tableF[0065] -> OP_FX65 (LD V1, [I])
+//On XO-CHIP, F000 nnnn is a double-length instruction: nnn holds the whole second word and
+//skips taken right before it advance past both words
+void Chip8::decode(Instruction& entry, uint16_t address, bool fuse_sequence) {
+    uint16_t opcode = (read(address) << 8u) | read(address + 1);
+
+    entry.nnn = opcode & 0x0FFFu;
+    entry.x = (opcode & 0x0F00u) >> 8u;
+    entry.y = (opcode & 0x00F0u) >> 4u;
+    entry.kk = opcode & 0x00FFu;
+    entry.n = opcode & 0x000Fu;
+    entry.skip = 2;
+
+    switch ((opcode & 0xF000u) >> 12u) {
+        case 0x0: entry.handler = tables->table0[entry.kk]; break;
+        case 0x5: entry.handler = tables->table5[entry.n]; break;
+        case 0x8: entry.handler = tables->table8[entry.n]; break;
+        case 0xE: entry.handler = tables->tableE[entry.n]; break;
+        case 0xF: entry.handler = tables->tableF[entry.kk]; break;
+        default: entry.handler = tables->table[(opcode & 0xF000u) >> 12u]; break;
+    }
+
+    if (machine == Machine::XoChip) {
+        uint16_t next = (read(address + 2) << 8u) | read(address + 3);
+        if (entry.handler == OP_F000) entry.nnn = next;
+        if (next == 0xF000u) entry.skip = 4;
+    }
+
+    entry.base = entry.handler;
+    entry.length = 1;
+    if (fuse_sequence) fuse(entry, address);
+}
+
+//Superinstruction pass over the instructions following a freshly decoded one
+//Matching sequences get a fused handler on their first entry only. The entries after it keep
+//their own handlers, so a jump or skip into the middle of a sequence runs it from there as usual.
+//None of the fused instructions write memory, so a sequence can't modify itself
+void Chip8::fuse(Instruction& entry, uint16_t address) {
+    if (entry.base != OP_ANNN && entry.base != OP_6XKK && entry.base != OP_FX07 && entry.base != OP_7XKK) return;
+
+    //Followers are decoded alone, fusing them too would recurse through long runs
+    auto follower = [this, address](unsigned int index) -> const Instruction& {
+        uint16_t follower_address = (address + 2 * index) & memory_mask;
+        Instruction& next = decoded(follower_address);
+        if (next.handler == OP_DECODE) decode(next, follower_address, false);
+        return next;
+    };
+
+    uint8_t second = follower(1).base;
+    bool draw = second == OP_DXYN || second == OP_DXYN_WIDE || second == OP_DXYN_WRAP || second == OP_DXYN_WIDE_WRAP;
+    if (entry.base == OP_ANNN && draw) {
+        entry.handler = OP_ANNN_DXYN;
+        entry.length = 2;
+    }
+    else if (entry.base == OP_6XKK && second == OP_6XKK) {
+        unsigned int length = 2;
+        while (length < MAX_FUSED && follower(length).base == OP_6XKK) length++;
+        entry.handler = OP_6XKK_RUN;
+        entry.length = length;
+    }
+    else if (entry.base == OP_FX07 && second == OP_3XKK) {
+        entry.handler = OP_FX07_3XKK;
+        entry.length = 2;
+    }
+    else if (entry.base == OP_7XKK && second == OP_3XKK && follower(1).x == entry.x) {
+        entry.handler = OP_7XKK_3XKK;
+        entry.length = 2;
+    }
+}
+
+//Drops cached decodes overlapping memory[address, address + length)
+//Includes the entry one byte before, since its opcode spans into address
+//Fused sequences starting up to MAX_FUSED - 1 instructions earlier read it too, which also
+//covers XO-CHIP decodes reading the following word (F000 nnnn, skips over it)
+//Those entries can sit on the previous page, which is then owned and unsealed too
+void Chip8::invalidate(uint16_t address, uint16_t length) {
+    const unsigned int before = 2 * MAX_FUSED - 1;
+    const unsigned int count = length + before;
+    for (unsigned int i = 0; i < count;) {
+        unsigned int at = (address - before + i) & memory_mask;
+        unsigned int index = at >> MEMORY_PAGE_SHIFT;
+        unsigned int offset = at & (MEMORY_PAGE_SIZE - 1);
+        unsigned int chunk = std::min(count - i, MEMORY_PAGE_SIZE - offset);
+
+        Instruction* entries = &ownPage(index)->data.decoded[offset];
+        for (unsigned int j = 0; j < chunk; j++) {
+            entries[j].handler = OP_DECODE;
+            entries[j].base = OP_DECODE;
+            entries[j].length = 1;
+        }
+        unsealed[index / 64] |= 1ull << (index % 64);
+        i += chunk;
+    }
+
+    //Length is at most all of memory, so the page range wraps at most once
+    if (length) {
+        unsigned int last = (address + length - 1u) >> page_shift;
+        for (unsigned int page = address >> page_shift; page <= last; page++) dirty_pages |= 1ull << (page & 63u);
+    }
+
+    if (jit) jit->invalidate(address, length);
+    if (aot) aot->invalidate(address, length);
+}
+
+void Chip8::setEngine(Engine engine) {
+#ifdef CHIP8_PROFILE
+    //Compiled blocks would bypass the counters in cycle()
+    engine = Engine::Interpreter;
+#endif
+    //The recompiler and the specialized handlers only know CHIP-8 and the 4 KB decode cache
+    if (machine != Machine::Chip8) engine = Engine::Interpreter;
+    //They are compiled with the CHIP-8 behavior written into them
+    if ((engine == Engine::Specialized || engine == Engine::Aot) && quirks != Quirks::defaults(Machine::Chip8)) {
+        engine = Engine::Interpreter;
+    }
+
+#ifdef CHIP8_SPECIALIZED
+    specialized = engine == Engine::Specialized;
+#endif
+
+    if (engine == Engine::Jit && Jit::available()) {
+        if (!jit) jit.reset(new Jit(*this));
+    }
+    else {
+        jit.reset();
+    }
+
+    const AotProgram* program = engine == Engine::Aot ? Aot::find(*this) : nullptr;
+    if (program) aot.reset(new Aot(*this, *program));
+    else aot.reset();
+}
+
+Engine Chip8::getEngine() const {
+    if (jit) return Engine::Jit;
+    if (aot) return Engine::Aot;
+    return specialized ? Engine::Specialized : Engine::Interpreter;
+}
+
+bool Chip8::frameDirty() const {
+    return dirty_rows != 0;
+}
+
+uint32_t Chip8::takeDirtyRows() {
+    uint32_t rows = dirty_rows;
+    dirty_rows = 0;
+    return rows;
+}
+
+uint64_t Chip8::takeDirtyPages() {
+    uint64_t pages = dirty_pages;
+    dirty_pages = 0;
+    return pages;
+}
+
+void Chip8::setQuirks(const Quirks& selected) {
+    if (selected == quirks) return;
+    quirks = selected;
+    tables = &decodeTables(machine, quirks);
+    dropDecodes();
+    setEngine(getEngine());
+}
+
+const Quirks& Chip8::getQuirks() const {
+    return quirks;
+}
+
+void Chip8::setDrawMode(DrawMode mode) {
+    Quirks selected = quirks;
+    selected.wrap = mode == DrawMode::Wrap;
+    setQuirks(selected);
+}
+
+void Chip8::setIdleSkip(bool enabled) {
+    idle_skip = enabled;
+}
+
+void Chip8::setDisplayWait(bool enabled) {
+    display_wait = enabled;
+    if (!enabled) vblank_wait = false;
+}
+
+uint16_t Chip8::takeObservedKeys() {
+    uint16_t keys = observed_keys;
+    observed_keys = 0;
+    return keys;
+}
+
+uint64_t Chip8::idleSkipped() const {
+    return idle_skipped;
+}
+
+//splitmix64 scramble so nearby seeds give unrelated streams and the state is never zero
+void Rng::seed(uint64_t value) {
+    value += 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    value ^= value >> 31;
+    state = value ? value : 0x9E3779B97F4A7C15ull;
+}
+
+uint8_t Rng::nextByte() {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return (state * 0x2545F4914F6CDD1Dull) >> 56;
+}
+
+void Chip8::seed(uint32_t value) {
+    rng.seed(value);
+}
+
+void Chip8::saveState(Snapshot& snapshot) const {
+    snapshot.version = Snapshot::VERSION;
+    snapshot.machine = machine;
+    snapshot.hires = hires;
+    snapshot.plane_mask = plane_mask;
+    snapshot.pitch = pitch;
+    memcpy(snapshot.registers, registers, sizeof(registers));
+    readBlock(0, snapshot.memory, memory_mask + 1u);
+    memcpy(snapshot.stack, stack, sizeof(stack));
+    snapshot.memory_index = memory_index;
+    snapshot.program_counter = program_counter;
+    snapshot.stack_pointer = stack_pointer;
+    snapshot.delay_timer = delay_timer;
+    snapshot.sound_timer = sound_timer;
+    memcpy(snapshot.keypad, keypad, sizeof(keypad));
+    memcpy(snapshot.video, video, sizeof(snapshot.video));
+    memcpy(snapshot.xvideo, xvideo, sizeof(snapshot.xvideo));
+    memcpy(snapshot.flags, flags, sizeof(flags));
+    memcpy(snapshot.audio_pattern, audio_pattern, sizeof(audio_pattern));
+    snapshot.rng = rng;
+}
+
+//Restores state, only dropping decoded instructions for memory that actually differs
+bool Chip8::loadState(const Snapshot& snapshot) {
+    if (snapshot.version != Snapshot::VERSION) return false;
+    if (snapshot.machine != machine) setMachine(snapshot.machine);
+
+    //Pages shared with copies of this machine are only copied if they differ
+    const unsigned int chunk = 64;
+    uint8_t current[chunk];
+    for (unsigned int address = 0; address <= memory_mask; address += chunk) {
+        readBlock(address, current, chunk);
+        if (memcmp(current, &snapshot.memory[address], chunk) != 0) writeBlock(address, &snapshot.memory[address], chunk);
+    }
+
+    memcpy(registers, snapshot.registers, sizeof(registers));
+    memcpy(stack, snapshot.stack, sizeof(stack));
+    memory_index = snapshot.memory_index;
+    program_counter = snapshot.program_counter;
+    stack_pointer = snapshot.stack_pointer;
+    delay_timer = snapshot.delay_timer;
+    sound_timer = snapshot.sound_timer;
+    memcpy(keypad, snapshot.keypad, sizeof(keypad));
+    if (memcmp(video, snapshot.video, sizeof(snapshot.video)) != 0) memcpy(ownVideo(), snapshot.video, sizeof(snapshot.video));
+    if (memcmp(xvideo, snapshot.xvideo, sizeof(snapshot.xvideo)) != 0) memcpy(ownWideVideo(), snapshot.xvideo, sizeof(snapshot.xvideo));
+    memcpy(flags, snapshot.flags, sizeof(flags));
+    memcpy(audio_pattern, snapshot.audio_pattern, sizeof(audio_pattern));
+    hires = snapshot.hires != 0;
+    plane_mask = snapshot.plane_mask;
+    pitch = snapshot.pitch;
+    rng = snapshot.rng;
+
+    dirty_rows = 0xFFFFFFFFu;
+    return true;
+}
+
+uint8_t Chip8::getRegister(unsigned int index) const {
+    return registers[index & 0xFu];
+}
+
+uint16_t Chip8::getProgramCounter() const {
+    return program_counter;
+}
+
+uint16_t Chip8::getIndex() const {
+    return memory_index;
+}
+
+uint8_t Chip8::getMemory(uint16_t address) const {
+    return read(address);
 }
 
 
 //ROM Loader
 //Reads ROM as binary and loads into memory using buffer array
-void Chip8::loadRom(const char* filename) {
-    std:: ifstream file(filename, std::ios::binary | std::ios::ate);
+bool Chip8::loadRom(const char* filename) {
+    std::shared_ptr<const RomImage> image = RomCache::global().load(filename);
+    if (!image) return false;
 
-    if (file.is_open()) {
-        std::streampos filesize = file.tellg();
-        char* buffer = new char[filesize];
+    return loadRom(*image);
+}
 
-        file.seekg(0, std::ios::beg);
-        file.read(buffer, filesize);
-        file.close();
+//Loads program bytes already in memory (tests, benchmarks, embedded ROMs)
+bool Chip8::loadRom(const uint8_t* data, size_t size) {
+    if (size == 0 || size > memory_mask + 1u - START_ADDRESS) return false;
 
-        for (long i = 0; i < filesize; i++) {
-            memory[start_address + i] = buffer[i];
-        }
-            delete[] buffer;
+    writeBlock(START_ADDRESS, data, size);
+    return true;
+}
+
+bool Chip8::loadRom(const RomImage& image) {
+    //Extended machines keep their big font, so only the program is copied
+    if (machine != Machine::Chip8 || image.size > MEM_SIZE - START_ADDRESS) {
+        return loadRom(image.program.data(), image.program.size());
     }
+
+    writeBlock(0, image.memory, MEM_SIZE);
+    return true;
 }
 
 //Fetch-Decode-Execute cycle
 void Chip8::cycle() {
+    static_assert(sizeof(handlers) / sizeof(handlers[0]) == HANDLER_COUNT, "handlers out of sync with Chip8::Handler");
+
+    //Fetch cached instruction for current address
+    //Entries that haven't been decoded yet dispatch to op_decode
+    const Instruction& entry = decoded(program_counter);
 
-    //Fetch opcode from memory (get first half, left shift, get second half)
-    //opcode is 16-bit, so it is stored across 2 8-bit memory values
-    opcode = (memory[program_counter] << 8u) | memory[program_counter + 1];
+#ifdef CHIP8_PROFILE
+    //XO-CHIP addresses above 4 KB share slots
+    profile.pc_hits[program_counter & (Profile::PC_SLOTS - 1)]++;
+    profile.instructions++;
+#endif
 
     //Increment program counter before execution
     program_counter += 2;
 
-    //Decode and Execute: use first bit of opcode as index into function pointer table
-    //Ex. 00E0 -> table[0x1nnn & 0xF000] -> table[0x1000 >> 12u] -> table[0x1] -> op_1nnn
-    ( (*this).*(table[(opcode & 0xF000u) >> 12u]) )();
+    //Execute: single indirect call through handler table
+    //Always exactly one instruction, fused sequences only run from run()
+    inst = &entry;
+    ( (*this).*(handlers[entry.base]) )();
+
+#ifdef CHIP8_PROFILE
+    //Counted after execution so first visits count as the decoded handler, not op_decode
+    static_assert(Profile::MAX_HANDLERS >= HANDLER_COUNT, "Profile::handler_counts too small for Chip8::Handler");
+    profile.handler_counts[entry.base]++;
+#endif
+}
+
+//Executes budget instructions on the selected engine
+unsigned int Chip8::run(unsigned int budget) {
+    unsigned int executed = 0;
+
+#ifdef CHIP8_PROFILE
+    //Counters live in cycle(), so fused sequences, idle skipping and compiled blocks are bypassed
+    //Counts and times describe that path, not the one a normal build takes (printProfile says so)
+    auto start = std::chrono::steady_clock::now();
+    while (executed < budget) {
+        cycle();
+        executed++;
+    }
+    profile.run_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    return executed;
+#endif
+
+    //Only loop heads are checked, everything else costs one compare on the cached handler
+    while (executed < budget) {
+        const Instruction& entry = decoded(program_counter);
+        uint8_t handler = entry.base;
+        if (idle_skip && (handler == OP_1NNN || handler == OP_FX07 || handler == OP_FX0A || handler == OP_00FD)) {
+            unsigned int skipped = skipIdle(budget - executed);
+            if (skipped) {
+                executed += skipped;
+                continue;
+            }
+        }
+
+        if (jit) executed += jit->run(budget - executed);
+        else if (aot) {
+            //Blocks don't read the decode cache, it only has to be decoded for the idle check above
+            uint16_t address = program_counter & memory_mask;
+            if (entry.handler == OP_DECODE) decode(decoded(address), address);
+            executed += aot->run(budget - executed);
+        }
+#ifdef CHIP8_SPECIALIZED
+        else if (specialized) {
+            //Operands come from the opcode, the cache entry only has to be decoded for the idle check above
+            uint16_t address = program_counter & memory_mask;
+            if (entry.handler == OP_DECODE) decode(decoded(address), address);
+            uint16_t opcode = (read(address) << 8u) | read(address + 1);
+            program_counter += 2;
+            Specialized::handlers[opcode](*this);
+            executed++;
+        }
+#endif
+        else if (entry.length <= budget - executed) {
+            //Same as cycle(), except a fused sequence runs whole when it fits in the budget
+            //Length is read first, op_decode may fuse the entry it executes
+            unsigned int length = entry.length;
+            program_counter += 2;
+            inst = &entry;
+            ( (*this).*(handlers[entry.handler]) )();
+            executed += length;
+        }
+        else {
+            cycle();
+            executed++;
+        }
+    }
+    return executed;
+}
+
+//Costs the instruction about to run, registers are read before it changes them
+//Dxyn shifts every sprite byte into place one bit at a time, register transfers loop per register
+uint32_t Chip8::cycleCost(const Instruction& entry) const {
+    static_assert(sizeof(vip_cycles) / sizeof(vip_cycles[0]) == HANDLER_COUNT, "vip_cycles out of sync with Chip8::Handler");
+
+    switch (entry.base) {
+        case OP_DXYN:
+        case OP_DXYN_WRAP:
+            return 68 + entry.n * (16 + 4 * (registers[entry.x] & 7u));
+        case OP_DXYN_WIDE:
+        case OP_DXYN_WIDE_WRAP:
+            //Dxy0 draws 16 rows of 2 bytes
+            return 68 + (entry.n ? entry.n : 32) * (16 + 4 * (registers[entry.x] & 7u));
+        case OP_FX55:
+        case OP_FX65:
+        case OP_FX55_I:
+        case OP_FX65_I:
+        case OP_FX75:
+        case OP_FX85:
+            return 14 + 14 * (entry.x + 1);
+        case OP_5XY2:
+        case OP_5XY3:
+            return 14 + 14 * ((entry.x > entry.y ? entry.x - entry.y : entry.y - entry.x) + 1);
+        case OP_F002:
+            return 14 + 14 * AUDIO_PATTERN_SIZE;
+        default:
+            return vip_cycles[entry.base];
+    }
+}
+
+unsigned int Chip8::runCycles(uint32_t budget, uint32_t& used) {
+    unsigned int executed = 0;
+    used = 0;
+
+    //Waiting for the vertical blank after a draw
+    if (vblank_wait) {
+        used = budget;
+        return 0;
+    }
+
+    while (used < budget) {
+        uint16_t address = program_counter & memory_mask;
+        Instruction& entry = decoded(address);
+        if (entry.handler == OP_DECODE) decode(entry, address);
+
+        //A spin-wait runs whole iterations of its loop until the budget can't hold another
+        unsigned int length = idle_skip ? idleLoop() : 0;
+        if (length) {
+            uint32_t loop = 0;
+            for (unsigned int i = 0; i < length; i++) loop += cycleCost(decoded(address + 2 * i));
+            uint32_t iterations = (budget - used) / loop;
+            if (iterations) {
+                if (entry.base == OP_FX07) registers[entry.x] = delay_timer;
+                used += iterations * loop;
+                executed += iterations * length;
+                idle_skipped += iterations * length;
+                continue;
+            }
+        }
+
+        //Read before executing, a write to its own page moves the entry
+        uint8_t handler = entry.base;
+        used += cycleCost(entry);
+        cycle();
+        executed++;
+
+        if (display_wait && (handler == OP_DXYN || handler == OP_DXYN_WRAP || handler == OP_DXYN_WIDE || handler == OP_DXYN_WIDE_WRAP)) {
+            vblank_wait = true;
+            used = std::max(used, budget);
+        }
+    }
+    return executed;
+}
+
+//Recognizes a spin-wait at program counter: timers and keypad only change between run() calls,
+//so within one call these loops are fixed points
+unsigned int Chip8::idleLoop() {
+    uint16_t address = program_counter & memory_mask;
+    const Instruction& head = decoded(address);
+
+    if ((head.base == OP_1NNN && head.nnn == address) || head.base == OP_00FD) {
+        //JP to itself, or SCHIP EXIT which halts by re-executing itself
+        return 1;
+    }
+    if (head.base == OP_FX0A) {
+        //Waiting for a key, op_fx0a rewinds program counter while none is held
+        bool pressed = false;
+        for (unsigned int key = 0; key < KEY_COUNT; key++) pressed |= keypad[key] != 0;
+        return pressed ? 0 : 1;
+    }
+    if (head.base == OP_FX07 && address <= memory_mask - 5u) {
+        //LD Vx, DT / SE|SNE Vx, kk / JP back: polls the delay timer until it reaches kk
+        Instruction& test = decoded(address + 2);
+        Instruction& jump = decoded(address + 4);
+        if (test.handler == OP_DECODE) decode(test, address + 2);
+        if (jump.handler == OP_DECODE) decode(jump, address + 4);
+
+        bool waiting = (test.base == OP_3XKK && delay_timer != test.kk) || (test.base == OP_4XKK && delay_timer == test.kk);
+        if (waiting && test.x == head.x && jump.base == OP_1NNN && jump.nnn == address) return 3;
+    }
+    return 0;
+}
+
+//Returns how many of budget instructions the spin-wait at program counter would burn without
+//changing state, leaving the machine exactly where interpreting them would have
+unsigned int Chip8::skipIdle(unsigned int budget) {
+    unsigned int length = idleLoop();
+    if (!length || budget < length) return 0;
+
+    //Whole iterations only, the remainder is interpreted normally
+    //The skipped Fx07s leave Vx holding the timer they polled
+    const Instruction& head = decoded(program_counter);
+    if (head.base == OP_FX07) registers[head.x] = delay_timer;
+    unsigned int skipped = budget - budget % length;
 
-    //Decrement delay and sound timers if set
+    idle_skipped += skipped;
+    return skipped;
+}
+
+//Decrement delay and sound timers if set
+void Chip8::tickTimers() {
     if (delay_timer > 0) delay_timer--;
     if (sound_timer > 0) sound_timer--;
+    vblank_wait = false;
+
+#ifdef CHIP8_PROFILE
+    uint64_t frame = profile.instructions - profile.frame_start;
+    if (profile.frames == 0 || frame < profile.frame_min) profile.frame_min = frame;
+    if (frame > profile.frame_max) profile.frame_max = frame;
+    profile.frame_start = profile.instructions;
+    profile.frames++;
+#endif
 }
 
 //00E0: CLS
 //Clear display
 void Chip8::op_00e0() {
-    memset(video, 0, sizeof(video));
+    if (machine == Machine::Chip8) memset(ownVideo(), 0, sizeof(VideoPage::rows));
+    else {
+        //Only the bitplanes selected by Fn01
+        uint64_t (*planes)[HIRES_HEIGHT][2] = ownWideVideo();
+        for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+            if (plane_mask & (1u << plane)) memset(planes[plane], 0, sizeof(planes[plane]));
+        }
+    }
+    dirty_rows = 0xFFFFFFFFu;
 }
 
 
 //00EE: RET
 //Return from subroutine
 //Sets program counter to previous address on stack
+//Stack pointer is masked so runaway programs wrap instead of writing past the stack
 void Chip8::op_00ee() {
     stack_pointer--;
-    program_counter = stack[stack_pointer];
+    program_counter = stack[stack_pointer & (STACK_SIZE - 1)];
 }
 
 //1nnn: JP nnn
 //Set program counter to address nnn
 //Gets address from opcode by zeroing first value, leaving nnn
 void Chip8::op_1nnn() {
-    uint16_t address = opcode & 0x0FFFu;
+    uint16_t address = inst->nnn;
 
     program_counter = address;
 }
@@ -186,9 +1122,9 @@ void Chip8::op_1nnn() {
 //Calls subroutine at nnn
 //Puts currently stored program counter onto stack, increments stack pointer, and updates program counter
 void Chip8::op_2nnn() {
-    uint16_t address = opcode & 0x0FFFu;
+    uint16_t address = inst->nnn;
 
-    stack[stack_pointer] = program_counter;
+    stack[stack_pointer & (STACK_SIZE - 1)] = program_counter;
     stack_pointer++;
     program_counter = address;
 }
@@ -197,82 +1133,88 @@ void Chip8::op_2nnn() {
 //3xkk: SE Vx, kk
 //Skips next instruction if Vx = kk
 void Chip8::op_3xkk() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t kk = opcode & 0x00FFu;
-    if (registers[vx] == kk) program_counter += 2;
+    uint8_t vx = inst->x;
+    uint8_t kk = inst->kk;
+    if (registers[vx] == kk) program_counter += inst->skip;
 }
 
 //4xkk: SNE Vx, kk
 //Skips next instruction if Vx != kk
 void Chip8::op_4xkk() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t kk = opcode & 0x00FFu;
-    if (registers[vx] != kk) program_counter += 2;
+    uint8_t vx = inst->x;
+    uint8_t kk = inst->kk;
+    if (registers[vx] != kk) program_counter += inst->skip;
 }
 
 
 //5xy0: SE Vx, Vy
 //Skips next instruction if Vx == Vy
 void Chip8::op_5xy0() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (opcode & 0x00F0u) >> 4u;
-    if (registers[vx] == registers[vy]) program_counter += 2;
+    uint8_t vx = inst->x;
+    uint8_t vy = inst->y;
+    if (registers[vx] == registers[vy]) program_counter += inst->skip;
 }
 
 //6xkk: LD Vx, kk
 //Sets Vx = kk
 void Chip8::op_6xkk() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t kk = opcode & 0x00FFu;
+    uint8_t vx = inst->x;
+    uint8_t kk = inst->kk;
     registers[vx] = kk;
 }
 
 //7xkk: ADD Vx, kk
 //Adds kk to Vx
 void Chip8::op_7xkk() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t kk = opcode & 0x00FFu;
+    uint8_t vx = inst->x;
+    uint8_t kk = inst->kk;
     registers[vx] += kk;
 }
 
 //8xy0: LD Vx, Vy
 //Sets Vx = Vy
 void Chip8::op_8xy0() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t vx = inst->x;
+    uint8_t vy = inst->y;
     registers[vx] = registers[vy];
 }
 
 //8xy1: OR Vx, Vy
-//Sets Vx = Vx OR Vy
+//Sets Vx = Vx OR Vy, then VF = 0 with vf_reset (COSMAC VIP)
+template <bool ResetVf>
 void Chip8::op_8xy1() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t vx = inst->x;
+    uint8_t vy = inst->y;
     registers[vx] |= registers[vy];
+    if constexpr (ResetVf) registers[0xF] = 0;
 }
 
 //8xy2: AND Vx, Vy
-//Sets Vx = Vx AND Vy
+//Sets Vx = Vx AND Vy, then VF = 0 with vf_reset (COSMAC VIP)
+template <bool ResetVf>
 void Chip8::op_8xy2() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t vx = inst->x;
+    uint8_t vy = inst->y;
     registers[vx] &= registers[vy];
+    if constexpr (ResetVf) registers[0xF] = 0;
 }
 
 //8xy3: XOR Vx, Vy
-//Sets Vx = Vx XOR Vy
+//Sets Vx = Vx XOR Vy, then VF = 0 with vf_reset (COSMAC VIP)
+template <bool ResetVf>
 void Chip8::op_8xy3() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t vx = inst->x;
+    uint8_t vy = inst->y;
     registers[vx] ^= registers[vy];
+    if constexpr (ResetVf) registers[0xF] = 0;
 }
 
 //8xy4: ADD Vx, Vy
 //Sets Vx = Vx + Vy and VF = carry
 //If result of Vx + Vy is over 8 bits (>255) set VF = 1, else VF = 0
 void Chip8::op_8xy4() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t vx = inst->x;
+    uint8_t vy = inst->y;
 
     uint16_t sum = registers[vx] + registers[vy];
     if (sum > 255U) registers[0xF] = 1;
@@ -285,8 +1227,8 @@ void Chip8::op_8xy4() {
 //Sets Vx = Vx - Vy and VF = NOT borrow
 //If Vx > Vy, set VF = 1, else VF = 0
 void Chip8::op_8xy5() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t vx = inst->x;
+    uint8_t vy = inst->y;
     
     if (registers[vx] > registers[vy]) registers[0xF] = 1;
     else registers[0xF] = 0;
@@ -294,21 +1236,29 @@ void Chip8::op_8xy5() {
     registers[vx] -= registers[vy];
 }
 
-//8xy6: SHR Vx
-//Sets Vx = Vx SHR 1
-//Right shifts Vx (divide by 2) and saves least significant bit in VF
+//8xy6: SHR Vx {, Vy}
+//Sets Vx = Vx SHR 1, or Vy SHR 1 with shift_vy (COSMAC VIP, flag written last)
+//Right shifts (divide by 2) and saves least significant bit in VF
+template <bool ShiftVy>
 void Chip8::op_8xy6() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    registers[0xF] = (registers[vx] & 0x1u);
-    registers[vx] >>= 1;
+    uint8_t vx = inst->x;
+    if constexpr (ShiftVy) {
+        uint8_t source = registers[inst->y];
+        registers[vx] = source >> 1;
+        registers[0xF] = source & 0x1u;
+    }
+    else {
+        registers[0xF] = (registers[vx] & 0x1u);
+        registers[vx] >>= 1;
+    }
 }
 
 //8xy7: SUBN Vx, Vy
 //Sets Vx = Vy - Vx and VF = NOT borrow
 //if Vy > Vx, set VF = 1, else VF = 0
 void Chip8::op_8xy7() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t vx = inst->x;
+    uint8_t vy = inst->y;
 
     if (registers[vy] > registers[vx]) registers[0xF] = 1;
     else registers[0xF] = 0;
@@ -317,97 +1267,120 @@ void Chip8::op_8xy7() {
 }
 
 //8xyE: SHL Vx {, Vy}
-//Sets Vx = Vx SHL 1
-//Left shifts Vx (multiply by 2) and saves most significant bit in VF
+//Sets Vx = Vx SHL 1, or Vy SHL 1 with shift_vy (COSMAC VIP, flag written last)
+//Left shifts (multiply by 2) and saves most significant bit in VF
+template <bool ShiftVy>
 void Chip8::op_8xye() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    registers[0xF] = (registers[vx] & 0x80u) >> 7u;
-    registers[vx] <<= 1;
+    uint8_t vx = inst->x;
+    if constexpr (ShiftVy) {
+        uint8_t source = registers[inst->y];
+        registers[vx] = source << 1;
+        registers[0xF] = (source & 0x80u) >> 7u;
+    }
+    else {
+        registers[0xF] = (registers[vx] & 0x80u) >> 7u;
+        registers[vx] <<= 1;
+    }
 }
 
 //9xy0: SNE Vx, Vy
 //Skips next instruction if Vx != Vy
 void Chip8::op_9xy0() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t vx = inst->x;
+    uint8_t vy = inst->y;
 
-    if (registers[vx] != registers[vy]) program_counter += 2;
+    if (registers[vx] != registers[vy]) program_counter += inst->skip;
 }
 
 //Annn: LD I, nnn
 //Sets memory_index = nnn
 void Chip8::op_annn() {
-    uint16_t address = opcode & 0x0FFFu;
+    uint16_t address = inst->nnn;
     memory_index = address;
 }
 
 //Bnnn: JP V0, nnn
-//Jumps to location V0 + nnn
+//Jumps to location V0 + nnn, or Vx + xnn with jump_vx (SCHIP)
+template <bool JumpVx>
 void Chip8::op_bnnn() {
-    uint16_t address = opcode & 0x0FFFu;
+    uint16_t address = inst->nnn;
 
-    program_counter = registers[0] + address;
+    program_counter = registers[JumpVx ? inst->x : 0] + address;
 }
 
 //Cxkk: RND Vx, kk
 //Sets Vx = random byte AND kk
 void Chip8::op_cxkk() {
-    uint8_t vx = (opcode & 0x0F00) >> 8u;
-    uint8_t kk = opcode & 0x00FFu;
-    registers[vx] = rand_byte(r) & kk;
+    uint8_t vx = inst->x;
+    uint8_t kk = inst->kk;
+    registers[vx] = rng.nextByte() & kk;
 }
 
 //Dxyn: DRW Vx, Vy, n
 //Display n-byte sprite starting at memory index at (Vx, Vy) and set VF = collision
-//Sprite is guaranteed 8 pixels wide
-//Iterate through sprite row by row and column by column
-//If collision, set VF = 1 and XOR pixel to flip
+//Sprite is guaranteed 8 pixels wide, so each sprite row is one shift and XOR into a packed row
+//Start position wraps; rows/columns past the edge are clipped or wrapped depending on Mode (wrap)
+template <DrawMode Mode>
 void Chip8::op_dxyn() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t vy = (opcode & 0x00F0u) >> 4u;
-    uint8_t height = opcode & 0x000Fu;
+#ifdef CHIP8_PROFILE
+    //Counters live in cycle(), so fused sequences, idle skipping and compiled blocks are bypassed
+    //Counts and times describe that path, not the one a normal build takes (printProfile says so)
+    auto start = std::chrono::steady_clock::now();
+#endif
+    uint8_t vx = inst->x;
+    uint8_t vy = inst->y;
+    uint8_t height = inst->n;
 
     //Wrap if beyond screen boundaries
     uint8_t xpos = registers[vx] % VIDEO_WIDTH;
     uint8_t ypos = registers[vy] % VIDEO_HEIGHT;
     registers[0xF] = 0;
+    uint64_t* rows = ownVideo();
+    uint8_t spill[0xF];
+    const uint8_t* sprite = bytesAt(memory_index, height, spill);
 
     for (unsigned int row = 0; row < height; row++) {
-        uint8_t sprite_byte = memory[memory_index + row];
-
-        for (unsigned int col = 0; col < 8; col++) {
-            uint8_t sprite_pixel = sprite_byte & (0x80u >> col);
-            uint32_t* screen_pixel = &video[(ypos + row) * VIDEO_WIDTH + (xpos + col)];
-
-            if (sprite_pixel) {
-                if (*screen_pixel == 0xFFFFFFFF) registers[0xF] = 1;
-
-                *screen_pixel ^= 0xFFFFFFFF;
-            }
+        unsigned int line = ypos + row;
+        if (line >= VIDEO_HEIGHT) {
+            if (Mode == DrawMode::Clip) break;
+            line -= VIDEO_HEIGHT;
         }
+
+        uint8_t sprite_byte = sprite[row];
+        if (drawSpriteRow(rows[line], sprite_byte, xpos, Mode)) registers[0xF] = 1;
+        if (sprite_byte) dirty_rows |= 1u << line;
     }
+
+#ifdef CHIP8_PROFILE
+    profile.draw_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+#endif
 }
 
 //Ex9E: SKP Vx
 //Skips next instruction if key with value of Vx is pressed
+//Only the low nibble of Vx selects the key
 void Chip8::op_ex9e() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
+    uint8_t key = registers[inst->x] & 0xFu;
 
-    if (keypad[registers[vx]]) program_counter += 2;
+    if (keypad[key]) {
+        program_counter += inst->skip;
+        observed_keys |= 1u << key;
+    }
 }
 
 //ExA1: SKNP Vx
 //Skips next instruction if key with value of Vx is not pressed
 void Chip8::op_exa1() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
+    uint8_t key = registers[inst->x] & 0xFu;
 
-    if (!keypad[registers[vx]]) program_counter += 2;
+    if (!keypad[key]) program_counter += inst->skip;
+    else observed_keys |= 1u << key;
 }
 
 //Fx07: LD Vx, DT
 //Sets Vx = delay timer value
 void Chip8::op_fx07() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
+    uint8_t vx = inst->x;
     registers[vx] = delay_timer;
 }
 
@@ -415,7 +1388,7 @@ void Chip8::op_fx07() {
 //Wait for a key press and store value of key in Vx
 //Waits for key press by decrementing program counter, effectively repeating the instruction
 void Chip8::op_fx0a() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
+    uint8_t vx = inst->x;
 
     if (keypad[0]) registers[vx] = 0;
     else if (keypad[1]) registers[vx] = 1;
@@ -433,27 +1406,32 @@ void Chip8::op_fx0a() {
     else if (keypad[13]) registers[vx] = 13;
     else if (keypad[14]) registers[vx] = 14;
     else if (keypad[15]) registers[vx] = 15;
-    else program_counter -= 2;
+    else {
+        program_counter -= 2;
+        return;
+    }
+
+    observed_keys |= 1u << registers[vx];
 }
 
 //Fx15: LD DT, Vx
 //Sets delay timer = Vx
 void Chip8::op_fx15() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
+    uint8_t vx = inst->x;
     delay_timer = registers[vx];
 }
 
 //Fx18: LD St, Vx
 //Sets sound timer = Vx
 void Chip8::op_fx18() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
+    uint8_t vx = inst->x;
     sound_timer = registers[vx];
 }
 
 //Fx1E: ADD I, Vx
 //Sets memory index = memory index + Vx
 void Chip8::op_fx1e() {
-    uint8_t  vx = (opcode & 0x0F00u) >> 8u;
+    uint8_t  vx = inst->x;
     memory_index += registers[vx];
 }
 
@@ -461,8 +1439,8 @@ void Chip8::op_fx1e() {
 //Sets index = location of sprite for digit vx
 //Fonts are located in 0x50 and are 5 bytes each, so gets address by taking an offset from fontset start address
 void Chip8::op_fx29() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    memory_index = fontset_start_address + (5 * registers[vx]);
+    uint8_t vx = inst->x;
+    memory_index = FONTSET_START_ADDRESS + (5 * registers[vx]);
 }
 
 //Fx33: LD B, Vx
@@ -472,35 +1450,325 @@ void Chip8::op_fx29() {
 //Places ones digit in index+2
 //Uses modulus to get rightmost digit and divides by 10 to remove rightmost digit
 void Chip8::op_fx33() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
+    uint8_t vx = inst->x;
     uint8_t val = registers[vx];
+    uint8_t digits[3];
 
-    memory[memory_index+2] = val % 10;
+    digits[2] = val % 10;
     val /= 10;
 
-    memory[memory_index+1] = val % 10;
+    digits[1] = val % 10;
     val /= 10;
 
-    memory[memory_index] = val % 10;
+    digits[0] = val % 10;
+
+    writeBlock(memory_index, digits, sizeof(digits));
 }
 
 //Fx55: LD [I], Vx
 //Stores registers V0 through Vx in memory starting at memory index
+//With load_store_increment (COSMAC VIP) memory index ends past the last register
+template <bool Increment>
 void Chip8::op_fx55() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
-    for (uint8_t i = 0; i <= vx; i++) {
-        memory[memory_index + i] = registers[i];
-    }
+    uint8_t vx = inst->x;
+    writeBlock(memory_index, registers, vx + 1u);
+    if constexpr (Increment) memory_index += vx + 1u;
 }
 
 //Fx65: LD Vx, [I]
 //Reads registers V0 through Vx from memory starting at memory index
+//With load_store_increment (COSMAC VIP) memory index ends past the last register
+template <bool Increment>
 void Chip8::op_fx65() {
-    uint8_t vx = (opcode & 0x0F00u) >> 8u;
+    uint8_t vx = inst->x;
+    uint8_t spill[REG_COUNT];
+    const uint8_t* values = bytesAt(memory_index, vx + 1u, spill);
+    for (uint8_t i = 0; i <= vx; i++) {
+        registers[i] = values[i];
+    }
+    if constexpr (Increment) memory_index += vx + 1u;
+}
+
+//Spreads each sprite bit over two pixels for low resolution on the 128x64 display
+static uint16_t doublePixels(uint8_t bits) {
+    uint16_t spread = bits;
+    spread = (spread | (spread << 4u)) & 0x0F0Fu;
+    spread = (spread | (spread << 2u)) & 0x3333u;
+    spread = (spread | (spread << 1u)) & 0x5555u;
+    return spread | (spread << 1u);
+}
+
+//Scrolls the selected bitplanes, distances are in display pixels
+//Low resolution moves twice as far so the picture scrolls by whole low resolution pixels
+void Chip8::scrollWide(int dx, int dy) {
+    int scale = hires ? 1 : 2;
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (plane_mask & (1u << plane)) scrollPlane(ownWideVideo()[plane], dx * scale, dy * scale);
+    }
+    dirty_rows = 0xFFFFFFFFu;
+}
+
+//00Cn: SCD n
+//Scrolls the display down n pixels
+void Chip8::op_00cn() {
+    scrollWide(0, inst->n);
+}
+
+//00Dn: SCU n
+//Scrolls the display up n pixels (XO-CHIP)
+void Chip8::op_00dn() {
+    scrollWide(0, -static_cast<int>(inst->n));
+}
+
+//00FB: SCR
+//Scrolls the display right 4 pixels
+void Chip8::op_00fb() {
+    scrollWide(4, 0);
+}
+
+//00FC: SCL
+//Scrolls the display left 4 pixels
+void Chip8::op_00fc() {
+    scrollWide(-4, 0);
+}
+
+//00FD: EXIT
+//Halts by rewinding program counter, effectively repeating the instruction
+void Chip8::op_00fd() {
+    program_counter -= 2;
+}
+
+//00FE: LOW
+//Switches to 64x32 and clears the display
+void Chip8::op_00fe() {
+    hires = false;
+    memset(ownWideVideo(), 0, sizeof(WideVideoPage::planes));
+    dirty_rows = 0xFFFFFFFFu;
+}
+
+//00FF: HIGH
+//Switches to 128x64 and clears the display
+void Chip8::op_00ff() {
+    hires = true;
+    memset(ownWideVideo(), 0, sizeof(WideVideoPage::planes));
+    dirty_rows = 0xFFFFFFFFu;
+}
+
+//5xy2: LD [I], Vx-Vy
+//Stores Vx through Vy (in either order) at memory index without changing it (XO-CHIP)
+void Chip8::op_5xy2() {
+    uint8_t vx = inst->x;
+    uint8_t vy = inst->y;
+    int step = vx <= vy ? 1 : -1;
+    unsigned int count = (vx <= vy ? vy - vx : vx - vy) + 1;
+    uint8_t values[REG_COUNT];
+
+    for (unsigned int i = 0; i < count; i++) {
+        values[i] = registers[vx + step * static_cast<int>(i)];
+    }
+
+    writeBlock(memory_index, values, count);
+}
+
+//5xy3: LD Vx-Vy, [I]
+//Reads Vx through Vy (in either order) from memory index without changing it (XO-CHIP)
+void Chip8::op_5xy3() {
+    uint8_t vx = inst->x;
+    uint8_t vy = inst->y;
+    int step = vx <= vy ? 1 : -1;
+    unsigned int count = (vx <= vy ? vy - vx : vx - vy) + 1;
+
+    for (unsigned int i = 0; i < count; i++) {
+        registers[vx + step * static_cast<int>(i)] = read(memory_index + i);
+    }
+}
+
+//Draws one plane's sprite onto the 128x64 display, xpos/ypos are display pixels
+//Sprite rows are 1 byte, or 2 for the 16x16 sprite; low resolution draws each bit as a 2x2 block
+//collisions counts sprite rows that turned a pixel off
+template <DrawMode Mode>
+void Chip8::drawWide(uint8_t plane, uint16_t address, unsigned int xpos, unsigned int ypos, unsigned int height, bool wide, unsigned int& collisions) {
+    unsigned int scale = hires ? 1 : 2;
+    unsigned int bytes = wide ? 2 : 1;
+    uint64_t (*rows)[2] = ownWideVideo()[plane];
+    uint8_t spill[2 * 16];
+    const uint8_t* sprite = bytesAt(address, height * bytes, spill);
+
+    for (unsigned int row = 0; row < height; row++) {
+        unsigned int line = ypos + row * scale;
+        if (line >= HIRES_HEIGHT) {
+            if (Mode == DrawMode::Clip) break;
+            line -= HIRES_HEIGHT;
+        }
+
+        bool collision = false;
+        bool lit = false;
+        for (unsigned int byte = 0; byte < bytes; byte++) {
+            uint8_t sprite_byte = sprite[row * bytes + byte];
+            if (!sprite_byte) continue;
+
+            unsigned int column = xpos + byte * 8 * scale;
+            if (column >= HIRES_WIDTH) {
+                if (Mode == DrawMode::Clip) break;
+                column -= HIRES_WIDTH;
+            }
+
+            uint16_t pixels = hires ? sprite_byte << 8u : doublePixels(sprite_byte);
+            for (unsigned int copy = 0; copy < scale; copy++) {
+                collision |= drawWideRow(rows[line + copy], pixels, column, Mode);
+            }
+            lit = true;
+        }
+
+        if (collision) collisions++;
+        if (lit) dirty_rows |= 1u << (line / 2);
+    }
+}
+
+//Dxyn: DRW Vx, Vy, n on the 128x64 display
+//n = 0 draws a 16x16 sprite. Each plane selected by Fn01 draws its own sprite, stored one after
+//another from memory index. VF is the number of colliding rows in SCHIP high resolution, else 0/1
+template <DrawMode Mode>
+void Chip8::op_dxyn_wide() {
+#ifdef CHIP8_PROFILE
+    //Counters live in cycle(), so fused sequences, idle skipping and compiled blocks are bypassed
+    //Counts and times describe that path, not the one a normal build takes (printProfile says so)
+    auto start = std::chrono::steady_clock::now();
+#endif
+    uint8_t vx = inst->x;
+    uint8_t vy = inst->y;
+    unsigned int height = inst->n;
+    bool wide = height == 0;
+    if (wide) height = 16;
+
+    //Wrap if beyond screen boundaries
+    unsigned int scale = hires ? 1 : 2;
+    unsigned int xpos = (registers[vx] * scale) % HIRES_WIDTH;
+    unsigned int ypos = (registers[vy] * scale) % HIRES_HEIGHT;
+
+    unsigned int collisions = 0;
+    uint16_t address = memory_index;
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        if (!(plane_mask & (1u << plane))) continue;
+        drawWide<Mode>(plane, address, xpos, ypos, height, wide, collisions);
+        address += height * (wide ? 2 : 1);
+    }
+
+    if (machine == Machine::SuperChip && hires) registers[0xF] = collisions;
+    else registers[0xF] = collisions ? 1 : 0;
+
+#ifdef CHIP8_PROFILE
+    profile.draw_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+#endif
+}
+
+//F000 nnnn: LD I, nnnn
+//Sets memory index to the 16-bit word after the opcode and steps over it (XO-CHIP)
+void Chip8::op_f000() {
+    memory_index = inst->nnn;
+    program_counter += 2;
+}
+
+//Fn01: PLANE n
+//Selects the bitplanes drawn, cleared and scrolled by later instructions (XO-CHIP)
+void Chip8::op_fn01() {
+    plane_mask = inst->x & 0x3u;
+}
+
+//F002: AUDIO
+//Loads the 16-byte audio pattern from memory index (XO-CHIP)
+//Kept in machine state only, there is no audio output
+void Chip8::op_f002() {
+    readBlock(memory_index, audio_pattern, AUDIO_PATTERN_SIZE);
+}
+
+//Fx30: LD HF, Vx
+//Sets index = location of the 10-byte big font sprite for digit Vx
+void Chip8::op_fx30() {
+    uint8_t vx = inst->x;
+    memory_index = BIG_FONTSET_START_ADDRESS + (10 * (registers[vx] & 0xFu));
+}
+
+//Fx3A: PITCH Vx
+//Sets audio pattern playback pitch (XO-CHIP), stored only
+void Chip8::op_fx3a() {
+    uint8_t vx = inst->x;
+    pitch = registers[vx];
+}
+
+//Fx75: LD R, Vx
+//Saves V0 through Vx to the persistent flag registers
+void Chip8::op_fx75() {
+    uint8_t vx = inst->x;
+    for (uint8_t i = 0; i <= vx; i++) {
+        flags[i] = registers[i];
+    }
+}
+
+//Fx85: LD Vx, R
+//Restores V0 through Vx from the persistent flag registers
+void Chip8::op_fx85() {
+    uint8_t vx = inst->x;
     for (uint8_t i = 0; i <= vx; i++) {
-        registers[i] = memory[memory_index + i];
+        registers[i] = flags[i];
+    }
+}
+
+//Annn, Dxyn
+void Chip8::op_annn_dxyn() {
+    memory_index = inst->nnn;
+
+    inst = &decoded(program_counter);
+    program_counter += 2;
+    ( (*this).*(handlers[inst->base]) )();
+}
+
+//6xkk, 6xkk, ...
+void Chip8::op_6xkk_run() {
+    uint16_t address = program_counter - 2;
+    unsigned int length = inst->length;
+
+    for (unsigned int i = 0; i < length; i++) {
+        const Instruction& load = decoded(address + 2 * i);
+        registers[load.x] = load.kk;
     }
+    program_counter += 2 * (length - 1);
+}
+
+//Fx07, 3xkk
+void Chip8::op_fx07_3xkk() {
+    registers[inst->x] = delay_timer;
+
+    const Instruction& test = decoded(program_counter);
+    program_counter += 2;
+    if (registers[test.x] == test.kk) program_counter += test.skip;
+}
+
+//7xkk, 3xkk on the same register (loop counter)
+void Chip8::op_7xkk_3xkk() {
+    uint8_t count = registers[inst->x] += inst->kk;
+
+    const Instruction& test = decoded(program_counter);
+    program_counter += 2;
+    if (count == test.kk) program_counter += test.skip;
 }
 
 //Dummy operation
-void Chip8::op_null() {}
\ No newline at end of file
+void Chip8::op_null() {}
+
+//Decode-on-miss
+//Decodes the instruction being executed into its cache entry, then runs it
+void Chip8::op_decode() {
+    uint16_t address = (program_counter - 2) & memory_mask;
+    Instruction& entry = decoded(address);
+
+    //Runs only this instruction, the caller counted one
+    decode(entry, address);
+    inst = &entry;
+    ( (*this).*(handlers[entry.base]) )();
+}
+
+//Instantiations the specialized handlers delegate to, see specialized.hpp
+template void Chip8::op_dxyn<DrawMode::Clip>();
+template void Chip8::op_fx55<false>();
+template void Chip8::op_fx65<false>();
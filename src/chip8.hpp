@@ -1,55 +1,442 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <fstream>
-#include <random>
 #include <chrono>
 #include <string.h>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "framebuffer.hpp"
+#include "profile.hpp"
 
 const unsigned int REG_COUNT = 16;
 const unsigned int MEM_SIZE = 4096;
+const unsigned int XO_MEM_SIZE = 65536;
 const unsigned int STACK_SIZE = 16;
 const unsigned int KEY_COUNT = 16;
 const unsigned int VIDEO_WIDTH = 64;
 const unsigned int VIDEO_HEIGHT = 32;
+const unsigned int START_ADDRESS = 0x200;
+const unsigned int FONTSET_START_ADDRESS = 0x50;
+const unsigned int FONTSET_SIZE = 80;
+const unsigned int BIG_FONTSET_START_ADDRESS = 0xA0;
+const unsigned int BIG_FONTSET_SIZE = 160;
+const unsigned int FLAG_COUNT = 16;
+const unsigned int AUDIO_PATTERN_SIZE = 16;
+//COSMAC VIP machine cycles a program gets per 60 Hz frame, see Chip8::runCycles()
+//The 1802 takes 8 clocks per machine cycle at 1.7609 MHz, 3668 per frame, and the display's DMA
+//takes 1024 of them (8 bytes for each of 128 scanlines)
+const unsigned int VIP_CYCLES_PER_FRAME = 3668 - 1024;
+
+extern const uint8_t FONTSET[FONTSET_SIZE];
+extern const uint8_t BIG_FONTSET[BIG_FONTSET_SIZE];
+
+//Instruction sets
+//SCHIP and XO-CHIP draw on the 128x64 display (see framebuffer.hpp), XO-CHIP adds 64 KB of
+//memory and a second bitplane
+enum class Machine : uint8_t {
+    Chip8,
+    SuperChip,
+    XoChip
+};
+
+//Behaviors that differ between CHIP-8 interpreters, ROMs are written against one of them
+//Each quirk selects a handler instantiated for it when the ROM's instructions are decoded, so
+//the handlers themselves never test a quirk
+struct Quirks {
+    bool shift_vy{};            //8xy6/8xyE shift Vy into Vx (COSMAC VIP) instead of shifting Vx
+    bool load_store_increment{}; //Fx55/Fx65 leave I past the last register transferred
+    bool jump_vx{};             //Bnnn jumps to xnn + Vx (SCHIP) instead of nnn + V0
+    bool wrap{};                //Dxyn wraps sprites past the right/bottom edge instead of clipping
+    bool vf_reset{};            //8xy1/8xy2/8xy3 clear VF
+
+    static const unsigned int COMBINATIONS = 32;
+
+    //What this core does without a profile: every quirk off, so shifts use Vx, Fx55/Fx65 leave I,
+    //Bnnn adds V0 and sprites clip, except that XO-CHIP wraps sprites like Octo
+    static Quirks defaults(Machine machine);
+    //Index among all COMBINATIONS quirk sets
+    unsigned int bits() const;
+    //Inverse of bits(), bits must be below COMBINATIONS
+    static Quirks fromBits(unsigned int bits);
+    bool operator==(const Quirks& other) const { return bits() == other.bits(); }
+    bool operator!=(const Quirks& other) const { return bits() != other.bits(); }
+};
+
+//Comma-separated profiles and quirks applied in order over quirks, false on an unknown name
+//An empty list changes nothing
+//Profiles vip, schip and xochip set all five, a quirk name (shift-vy, load-store-increment,
+//jump-vx, wrap, vf-reset) sets it, prefixed with no- clears it: "vip,no-vf-reset"
+bool parseQuirks(const std::string& text, Quirks& quirks);
+
+//Instruction decoded once and cached by address
+//Operands are pre-extracted so handlers don't re-mask the opcode
+struct Instruction {
+    uint16_t nnn;
+    uint8_t x;
+    uint8_t y;
+    uint8_t kk;
+    uint8_t n;
+    uint8_t handler; //Index into Chip8::handlers, OP_DECODE until decoded, may start a fused sequence
+    uint8_t skip; //Bytes a taken skip advances, 4 over an XO-CHIP F000 nnnn
+    uint8_t base; //Handler for this instruction alone
+    uint8_t length{1}; //Instructions executed by handler, more than 1 for a fused sequence
+};
+
+//xorshift64* generator behind Cxkk
+//Plain 8-byte state, so it is seedable, cheap, identical on every platform and fits in snapshots
+struct Rng {
+    uint64_t state{0x9E3779B97F4A7C15ull};
+
+    void seed(uint64_t value);
+    uint8_t nextByte();
+};
+
+//Complete machine state
+//Plain data, so a save or load is one fixed-size copy and the bytes can be diffed for rewind
+struct Snapshot {
+    static const uint32_t VERSION = 3;
+
+    uint32_t version;
+    uint8_t registers[REG_COUNT];
+    Machine machine;
+    uint8_t hires;
+    uint8_t plane_mask;
+    uint8_t pitch;
+    uint8_t memory[XO_MEM_SIZE];
+    uint16_t stack[STACK_SIZE];
+    uint16_t memory_index;
+    uint16_t program_counter;
+    uint8_t stack_pointer;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    uint8_t keypad[KEY_COUNT];
+    uint64_t video[VIDEO_HEIGHT];
+    uint64_t xvideo[PLANE_COUNT][HIRES_HEIGHT][2];
+    uint8_t flags[FLAG_COUNT];
+    uint8_t audio_pattern[AUDIO_PATTERN_SIZE];
+    Rng rng;
+};
+
+class Jit;
+class Aot;
+struct RomImage;
+struct Specialized;
+
+//Execution engines selectable at runtime
+enum class Engine {
+    Interpreter,
+    Jit,
+    //Per-opcode handlers, only in builds with CHIP8_SPECIALIZED, see specialized.hpp
+    Specialized,
+    //Recompiled blocks linked in for the loaded ROM, see aot.hpp
+    Aot
+};
+
 class Chip8 {
     public:
         Chip8();
+        //Forks: the copy shares memory and display with this machine, page by page, until either
+        //of them writes to a page, which copies just that page. Costs a few cache lines of CPU
+        //state plus a copy of each page this machine hasn't sealed (see seal()). The source is only
+        //read, but don't fork a machine another thread is running. Copies run on the interpreter, or the
+        //specialized handlers if selected: JIT and AOT code belong to one machine, see setEngine()
+        Chip8(const Chip8& other);
+        Chip8& operator=(const Chip8& other);
+        ~Chip8();
+        //Same as *this = source, but this machine keeps its engine. A JIT keeps its code buffer
+        //and drops every block, AOT is looked up again for the new memory. For environments that
+        //restart episodes from one prepared machine
+        void restartFrom(const Chip8& source);
 
         uint8_t keypad[KEY_COUNT]{};
-        uint32_t video[VIDEO_HEIGHT * VIDEO_WIDTH]{};
+        //Packed framebuffer, one bit per pixel, see framebuffer.hpp
+        //Read-only views of the display pages, they move when a write copies a shared page
+        const uint64_t* video{};
+        //Packed 128x64 bitplanes, used instead of video by SCHIP and XO-CHIP
+        //Low resolution draws each pixel as a 2x2 block, so this is always the full display
+        const uint64_t (*xvideo)[HIRES_HEIGHT][2]{};
+
+        //Selects the instruction set, clearing memory, display and CPU state
+        //Call before loading a ROM. Extended machines always run on the interpreter
+        void setMachine(Machine machine);
+        Machine getMachine() const;
 
-        void loadRom(const char* filename);
+        //Active display size, 64x32 for CHIP-8 and 128x64 otherwise
+        unsigned int displayWidth() const;
+        unsigned int displayHeight() const;
+        //FNV-1a hash of the active display, hashRows(video, VIDEO_HEIGHT) on CHIP-8
+        uint64_t hashDisplay() const;
+
+        //Program loading, returns false (leaving memory untouched) if the file can't be read
+        //or the program is empty or larger than memory after START_ADDRESS
+        //Files go through RomCache::global(), see rom.hpp for error details
+        bool loadRom(const char* filename);
+        bool loadRom(const uint8_t* data, size_t size);
+        //Loads a prepared image, one block write of all memory on CHIP-8 that also drops decoded instructions
+        bool loadRom(const RomImage& image);
         void cycle();
 
+        //Runs up to budget instructions on the selected engine
+        //JIT blocks that don't fit in the remaining budget are interpreted, so this never overshoots
+        unsigned int run(unsigned int budget);
+
+        //Runs instructions until their COSMAC VIP cost in machine cycles reaches budget, returns how many ran
+        //used receives the cycles spent, past budget by less than the last instruction's cost so
+        //callers can carry the excess into the next frame. Always interprets one instruction at a
+        //time whatever the engine, costs belong to instructions and not to blocks or fused sequences
+        unsigned int runCycles(uint32_t budget, uint32_t& used);
+        //VIP display wait for runCycles(): after a Dxyn the program waits for the vertical blank
+        //(the next tickTimers()), spending the rest of any budget until then. Off by default
+        void setDisplayWait(bool enabled);
+
+        //Decrements delay and sound timers, called at 60 Hz by the scheduler
+        //Also the vertical blank that ends a display wait
+        void tickTimers();
+
+        //Selects execution engine, falls back to the interpreter if the JIT isn't available
+        //Aot looks for a recompiled program matching memory, so select it after loading the ROM
+        void setEngine(Engine engine);
+        Engine getEngine() const;
+
+        //Frame change tracking, only set by 00E0, Dxyn and scrolls
+        //Bit y is set if row y changed since the last takeDirtyRows()
+        //On the 128x64 display bit y covers rows 2y and 2y + 1
+        bool frameDirty() const;
+        uint32_t takeDirtyRows();
+
+        //Memory change tracking, memory is split into 64 pages (64 bytes, or 1 KB on XO-CHIP)
+        //Bit p is set if page p was written since the last takeDirtyPages()
+        uint64_t takeDirtyPages();
+
+        //Instruction set differences, reset to Quirks::defaults() by setMachine()
+        //Drops every decoded instruction and compiled block. The specialized and AOT engines are
+        //compiled for the CHIP-8 defaults, under other quirks they fall back to the interpreter
+        void setQuirks(const Quirks& quirks);
+        const Quirks& getQuirks() const;
+        //Edge handling for Dxyn, the wrap quirk
+        void setDrawMode(DrawMode mode);
+
+        //Bit k is set once the program has seen key k held (Ex9E/ExA1 test, Fx0A accept)
+        //since the last call, used to measure input latency
+        uint16_t takeObservedKeys();
+
+        //Fast-forwarding of spin-waits inside run() and runCycles(), on by default
+        //Self-jumps, Fx0A without a key and Fx07/3xkk/1nnn delay polls can't change state
+        //until a timer tick or keypad change, so the rest of the budget is skipped
+        void setIdleSkip(bool enabled);
+        uint64_t idleSkipped() const;
+
+        //Reseeds the RNG used by Cxkk for reproducible runs
+        void seed(uint32_t value);
+
+        //Decodes every pending entry, so copies made afterwards share all memory pages
+        //Copying only reads the source, a sealed machine can be forked from several threads at once.
+        //Pages still pending are copied by each fork instead, seal a machine before forking it often
+        void seal();
+
+        //Copies full machine state out / back in
+        //loadState rejects snapshots from a different format version
+        void saveState(Snapshot& snapshot) const;
+        bool loadState(const Snapshot& snapshot);
+
+#ifdef CHIP8_PROFILE
+        //Per-handler, per-family and per-address counters plus draw timing
+        //The JIT is disabled in profile builds so every instruction is counted
+        const Profile& getProfile() const;
+        void printProfile(FILE* out, unsigned int top_addresses = 16) const;
+#endif
+
+        //Read-only views of CPU state for tooling
+        uint8_t getRegister(unsigned int index) const;
+        uint16_t getProgramCounter() const;
+        uint16_t getIndex() const;
+        //Byte at address, masked to memory size like the program's own reads
+        uint8_t getMemory(uint16_t address) const;
+
     private: 
+        friend class Jit;
+        friend class Aot;
+        friend class StateHash;
+        friend struct Specialized;
+
+        //Copy-on-write storage, shared with copies of this machine until one of them writes
+        //Memory is split into pages of bytes and their decoded instructions, listed by a page table
+        //that is shared the same way. A shared page is never written, decoding included: copies
+        //only share sealed pages and take their own copy of the rest, writes copy the page (ownPage)
+        static const unsigned int MEMORY_PAGE_SHIFT = 8;
+        static const unsigned int MEMORY_PAGE_SIZE = 1u << MEMORY_PAGE_SHIFT;
+        static const unsigned int MEMORY_PAGE_COUNT = XO_MEM_SIZE >> MEMORY_PAGE_SHIFT;
+
+        //Reference counted block from an arena (arena.hpp), one arena per type
+        template<typename Data>
+        struct Shared {
+            std::atomic<uint32_t> references;
+            Data data;
+        };
+        struct MemoryPage {
+            uint8_t bytes[MEMORY_PAGE_SIZE];
+            Instruction decoded[MEMORY_PAGE_SIZE];
+        };
+        struct PageTable {
+            unsigned int count;
+            Shared<MemoryPage>* pages[MEMORY_PAGE_COUNT];
+        };
+        struct VideoPage {
+            uint64_t rows[VIDEO_HEIGHT];
+        };
+        struct WideVideoPage {
+            uint64_t planes[PLANE_COUNT][HIRES_HEIGHT][2];
+        };
+
         uint8_t registers[REG_COUNT]{};
-        uint8_t memory[MEM_SIZE]{};
+        //MEM_SIZE bytes, or XO_MEM_SIZE on XO-CHIP, addresses are masked with memory_mask
+        Shared<PageTable>* page_table{};
+        uint16_t memory_mask{MEM_SIZE - 1};
         uint16_t stack[STACK_SIZE]{};
         uint16_t memory_index{};
         uint16_t program_counter{};
         uint8_t stack_pointer{};
         uint8_t delay_timer{};
         uint8_t sound_timer{};
-        uint16_t opcode;
-
-        std::default_random_engine r;
-        std::uniform_int_distribution<uint8_t> rand_byte;
-
-	    typedef void (Chip8::*Chip8Func)();
-        //Function pointer tables
-	    Chip8Func table[0xF + 1]; 
-        //Tables 0, 8, E have 16 possible permutations (last valid opcode ends in E)
-        //Table F has 102 possible permutations (last valid opcode ends in 65)
-	    Chip8Func table0[0xE + 1];
-	    Chip8Func table8[0xE + 1];
-	    Chip8Func tableE[0xE + 1]; 
-	    Chip8Func tableF[0x65 + 1];
-
-        void Table0();
-        void Table8();
-        void TableE();
-        void TableF();
+
+        //Bit p is set while memory page p may hold entries that aren't decoded yet
+        uint64_t unsealed[MEMORY_PAGE_COUNT / 64]{};
+        //Instruction currently being executed
+        const Instruction* inst{};
+
+        std::unique_ptr<Jit> jit;
+        bool specialized{};
+        std::unique_ptr<Aot> aot;
+
+#ifdef CHIP8_PROFILE
+        Profile profile{};
+#endif
+
+        Machine machine{Machine::Chip8};
+        //SCHIP/XO-CHIP display state: 128x64 mode, bitplanes selected by Fn01
+        bool hires{};
+        uint8_t plane_mask{1};
+        //Fx75/Fx85 persistent flags, XO-CHIP F002/Fx3A audio state (stored, not played)
+        uint8_t flags[FLAG_COUNT]{};
+        uint8_t audio_pattern[AUDIO_PATTERN_SIZE]{};
+        uint8_t pitch{64};
+
+        Quirks quirks{};
+        bool idle_skip{true};
+        bool display_wait{};
+        //Set by a Dxyn under display wait, cleared by tickTimers()
+        bool vblank_wait{};
+        uint16_t observed_keys{};
+        uint64_t idle_skipped{};
+        uint32_t dirty_rows{};
+        uint64_t dirty_pages{};
+        uint8_t page_shift{6};
+
+        Rng rng;
+
+        Shared<VideoPage>* video_page{};
+        Shared<WideVideoPage>* wide_video_page{};
+        //Same pointers as page_table, copied into the machine so lookups are one load shorter
+        //Last, away from the registers and program counter
+        Shared<MemoryPage>* pages[MEMORY_PAGE_COUNT]{};
+
+        typedef void (Chip8::*Chip8Func)();
+
+        //Handler indices stored in the decode cache
+        enum Handler : uint8_t {
+            OP_DECODE,
+            OP_00E0, OP_00EE, OP_1NNN, OP_2NNN, OP_3XKK, OP_4XKK, OP_5XY0, OP_6XKK,
+            OP_7XKK, OP_8XY0, OP_8XY1, OP_8XY2, OP_8XY3, OP_8XY4, OP_8XY5, OP_8XY6,
+            OP_8XY7, OP_8XYE, OP_9XY0, OP_ANNN, OP_BNNN, OP_CXKK, OP_DXYN, OP_EX9E,
+            OP_EXA1, OP_FX07, OP_FX0A, OP_FX15, OP_FX18, OP_FX1E, OP_FX29, OP_FX33,
+            OP_FX55, OP_FX65,
+            //SCHIP / XO-CHIP
+            OP_00CN, OP_00DN, OP_00FB, OP_00FC, OP_00FD, OP_00FE, OP_00FF, OP_5XY2,
+            OP_5XY3, OP_DXYN_WIDE, OP_F000, OP_FN01, OP_F002, OP_FX30, OP_FX3A, OP_FX75,
+            OP_FX85,
+            //Quirk variants, picked by the decode tables of quirk sets that use them
+            OP_8XY1_VF, OP_8XY2_VF, OP_8XY3_VF, OP_8XY6_VY, OP_8XYE_VY, OP_BXNN, OP_FX55_I, OP_FX65_I,
+            OP_DXYN_WRAP, OP_DXYN_WIDE_WRAP,
+            //Fused sequences
+            OP_ANNN_DXYN, OP_6XKK_RUN, OP_FX07_3XKK, OP_7XKK_3XKK,
+            OP_NULL,
+            HANDLER_COUNT
+        };
+        //HANDLER_COUNT entries, checked where chip8.cpp defines it
+        static const Chip8Func handlers[];
+
+        //Decode tables, only consulted when an address is first decoded
+        //One set per instruction set and quirk set, so each only decodes its own opcodes to the
+        //handlers for its quirks. Shared by all machines
+        struct DecodeTables {
+            uint8_t table[0xF + 1];
+            //Tables 5, 8, E are indexed by the last nibble
+            //Tables 0 and F are indexed by the last byte
+            uint8_t table0[0xFF + 1];
+            uint8_t table5[0xF + 1];
+            uint8_t table8[0xF + 1];
+            uint8_t tableE[0xF + 1];
+            uint8_t tableF[0xFF + 1];
+
+            void build(Machine machine, const Quirks& quirks);
+        };
+        static const DecodeTables& decodeTables(Machine machine, const Quirks& quirks);
+        const DecodeTables* tables{};
+
+        //Longest fused sequence, in instructions
+        static const unsigned int MAX_FUSED = 4;
+
+        //Memory reads, addresses are masked
+        uint8_t read(uint16_t address) const {
+            address &= memory_mask;
+            return pages[address >> MEMORY_PAGE_SHIFT]->data.bytes[address & (MEMORY_PAGE_SIZE - 1)];
+        }
+        void readBlock(uint16_t address, uint8_t* out, size_t size) const;
+        //size bytes at address, read in place unless they run past the end of their page, then
+        //copied to spill first. Sprites and register loads are short and rarely cross
+        const uint8_t* bytesAt(uint16_t address, size_t size, uint8_t* spill) const {
+            address &= memory_mask;
+            unsigned int offset = address & (MEMORY_PAGE_SIZE - 1);
+            if (offset + size > MEMORY_PAGE_SIZE) {
+                readBlock(address, spill, size);
+                return spill;
+            }
+            return &pages[address >> MEMORY_PAGE_SHIFT]->data.bytes[offset];
+        }
+        //Copies data to memory at address (wrapping) and drops the decodes and compiled code over it
+        //Memory is only written through here, so shared pages are copied first
+        void writeBlock(uint16_t address, const uint8_t* data, size_t size);
+
+        //Decoded instruction cache entry for address, OP_DECODE until decoded
+        Instruction& decoded(uint16_t address) {
+            address &= memory_mask;
+            return pages[address >> MEMORY_PAGE_SHIFT]->data.decoded[address & (MEMORY_PAGE_SIZE - 1)];
+        }
+
+        //Page about to be written, copied first if another machine shares it or the page table
+        Shared<MemoryPage>* ownPage(unsigned int index);
+        uint64_t* ownVideo();
+        uint64_t (*ownWideVideo())[HIRES_HEIGHT][2];
+        //Forgets every decoded entry and compiled block, for when the decode tables change
+        void dropDecodes();
+        static void releaseTable(Shared<PageTable>* table);
+        void releaseStorage();
+        //fuse_sequence = false decodes the instruction alone, as when it is read as part of another's sequence
+        void decode(Instruction& entry, uint16_t address, bool fuse_sequence = true);
+        void fuse(Instruction& entry, uint16_t address);
+        void invalidate(uint16_t address, uint16_t length);
+        //Instructions in the spin-wait at program counter, 0 if it isn't one
+        unsigned int idleLoop();
+        unsigned int skipIdle(unsigned int budget);
+
+        //COSMAC VIP machine cycles per handler, for the instruction alone
+        //0 where cycleCost() works it out from the operands
+        static const uint16_t vip_cycles[];
+        uint32_t cycleCost(const Instruction& entry) const;
 
         //CHIP-8 instructions
         void op_00e0(); //CLS
@@ -62,19 +449,20 @@ class Chip8 {
         void op_6xkk(); //LD Vx, kk
         void op_7xkk(); //ADD Vx, kk
         void op_8xy0(); //LD Vx, Vy
-        void op_8xy1(); //OR Vx, Vy
-        void op_8xy2(); //AND Vx, Vy
-        void op_8xy3(); //XOR Vx, Vy
+        //ResetVf: vf_reset quirk
+        template <bool ResetVf> void op_8xy1(); //OR Vx, Vy
+        template <bool ResetVf> void op_8xy2(); //AND Vx, Vy
+        template <bool ResetVf> void op_8xy3(); //XOR Vx, Vy
         void op_8xy4(); //ADD Vx, Vy
         void op_8xy5(); //SUB Vx, Vy
-        void op_8xy6(); //SHR Vx
+        template <bool ShiftVy> void op_8xy6(); //SHR Vx {, Vy}
         void op_8xy7(); //SUBN Vx, Vy
-        void op_8xye(); //SHL Vx, {, Vy}
+        template <bool ShiftVy> void op_8xye(); //SHL Vx {, Vy}
         void op_9xy0(); //SNE Vx, Vy
         void op_annn(); //LD i, nnn
-        void op_bnnn(); //JP V0, addr
+        template <bool JumpVx> void op_bnnn(); //JP V0, addr
         void op_cxkk(); //RND Vx, kk
-        void op_dxyn(); //DRW Vx, Vy, n
+        template <DrawMode Mode> void op_dxyn(); //DRW Vx, Vy, n
         void op_ex9e(); //SKP Vx
         void op_exa1(); //SKNP Vx
         void op_fx07(); //LD Vx, DT
@@ -84,9 +472,37 @@ class Chip8 {
         void op_fx1e(); //ADD i, Vx
         void op_fx29(); //LD f, Vx
         void op_fx33(); //LD b, Vx
-        void op_fx55(); //LD [i], Vx
-        void op_fx65(); //LD Vx, [i]
+        template <bool Increment> void op_fx55(); //LD [i], Vx
+        template <bool Increment> void op_fx65(); //LD Vx, [i]
+
+        //SCHIP / XO-CHIP instructions
+        void op_00cn(); //SCD n
+        void op_00dn(); //SCU n
+        void op_00fb(); //SCR
+        void op_00fc(); //SCL
+        void op_00fd(); //EXIT
+        void op_00fe(); //LOW
+        void op_00ff(); //HIGH
+        void op_5xy2(); //LD [i], Vx-Vy
+        void op_5xy3(); //LD Vx-Vy, [i]
+        template <DrawMode Mode> void op_dxyn_wide(); //DRW Vx, Vy, n on the 128x64 display, 16x16 when n = 0
+        void op_f000(); //LD i, nnnn
+        void op_fn01(); //PLANE n
+        void op_f002(); //AUDIO
+        void op_fx30(); //LD HF, Vx
+        void op_fx3a(); //PITCH Vx
+        void op_fx75(); //LD R, Vx
+        void op_fx85(); //LD Vx, R
+
+        //Superinstructions, each runs a whole sequence in one dispatch
+        void op_annn_dxyn(); //LD I, nnn then DRW Vx, Vy, n
+        void op_6xkk_run(); //Up to MAX_FUSED LD Vx, kk
+        void op_fx07_3xkk(); //LD Vx, DT then SE Vy, kk
+        void op_7xkk_3xkk(); //ADD Vx, kk then SE Vx, kk
+        template <DrawMode Mode> void drawWide(uint8_t plane, uint16_t address, unsigned int xpos, unsigned int ypos, unsigned int height, bool wide, unsigned int& collisions);
+        void scrollWide(int dx, int dy);
         void op_null(); //Do nothing
+        void op_decode(); //Decode current address, then execute
 
 
 };
\ No newline at end of file
@@ -0,0 +1,479 @@
+#include "chip8.hpp"
+#include "lockstep.hpp"
+#include "rom.hpp"
+#include "state_hash.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//Differential checker
+//Runs an engine side by side with the reference, Chip8::cycle() one instruction at a time, on
+//the same program, seed, timer ticks and key presses. Both state hashes are compared every
+//--check instructions; on a mismatch the run is replayed from the last matching check and
+//bisected with snapshots to the first instruction whose result differs
+//--fuzz N does the same for N random programs, spread across all cores
+//The lockstep candidate runs LockstepChip8 lanes, each against its own reference, compared
+//lane by lane with snapshots
+
+namespace {
+
+struct KeyEvent {
+    uint64_t cycle;
+    uint8_t key;
+    uint8_t pressed;
+};
+
+struct Options {
+    std::vector<std::string> roms;
+    std::vector<Engine> engines{Engine::Interpreter, Engine::Jit, Engine::Specialized, Engine::Aot};
+    bool lockstep{true};
+    Machine machine{Machine::Chip8};
+    //parseQuirks() list over the machine's defaults, for both machines
+    std::string quirks;
+    uint64_t cycles{100000};
+    uint64_t instructions_per_frame{10};
+    uint64_t interval{1000};
+    uint32_t seeds{1};
+    unsigned int threads{};
+    unsigned int fuzz{};
+    size_t fuzz_size{512};
+};
+
+struct Job {
+    std::string name;
+    std::vector<uint8_t> program;
+    uint32_t seed;
+    Engine engine;
+    //LockstepChip8 instead of a Chip8 engine
+    bool lockstep;
+};
+
+const char* engineName(const Job& job) {
+    if (job.lockstep) return "lockstep";
+    switch (job.engine) {
+        case Engine::Jit: return "jit";
+        case Engine::Specialized: return "specialized";
+        case Engine::Aot: return "aot";
+        default: return "interpreter";
+    }
+}
+
+//Random key presses and releases, a few hundred instructions apart
+std::vector<KeyEvent> keyEvents(uint32_t seed, uint64_t cycles) {
+    Rng rng;
+    rng.seed(seed ^ 0x4B455953u);
+
+    std::vector<KeyEvent> events;
+    uint64_t cycle = 0;
+    while (true) {
+        cycle += 1 + rng.nextByte() + (rng.nextByte() & 0x3u) * 256;
+        if (cycle >= cycles) break;
+        uint8_t key = rng.nextByte() & 0xFu;
+        events.push_back({cycle, key, static_cast<uint8_t>(rng.nextByte() & 1u)});
+    }
+    return events;
+}
+
+//Reference and candidate fed identical input, in identical steps
+class Session {
+    public:
+        Session(const Job& job, const Options& options) : job(job), options(options), events(keyEvents(job.seed, options.cycles)) {
+            Quirks quirks = Quirks::defaults(options.machine);
+            parseQuirks(options.quirks, quirks);
+            for (Chip8* chip8 : {&reference, &candidate}) {
+                chip8->setMachine(options.machine);
+                chip8->seed(job.seed);
+                chip8->loadRom(job.program.data(), job.program.size());
+                chip8->setQuirks(quirks);
+            }
+            candidate.setEngine(job.engine);
+        }
+
+        bool available() const {
+            return candidate.getEngine() == job.engine;
+        }
+
+        //Runs both machines to instruction target
+        //Steps end at frame boundaries and key events, which are applied to both between instructions
+        void advance(uint64_t target) {
+            while (executed < target) {
+                uint64_t step = std::min(target - executed, options.instructions_per_frame - executed % options.instructions_per_frame);
+                if (next_event < events.size()) step = std::min(step, events[next_event].cycle - executed);
+
+                candidate.run(static_cast<unsigned int>(step));
+                for (uint64_t i = 0; i < step; i++) reference.cycle();
+                executed += step;
+
+                if (executed % options.instructions_per_frame == 0) {
+                    reference.tickTimers();
+                    candidate.tickTimers();
+                }
+                for (; next_event < events.size() && events[next_event].cycle == executed; next_event++) {
+                    reference.keypad[events[next_event].key] = events[next_event].pressed;
+                    candidate.keypad[events[next_event].key] = events[next_event].pressed;
+                }
+            }
+        }
+
+        //Both machines at instruction position, restored from snapshots taken there
+        void restore(const Snapshot& reference_state, const Snapshot& candidate_state, uint64_t position, size_t event) {
+            reference.loadState(reference_state);
+            candidate.loadState(candidate_state);
+            executed = position;
+            next_event = event;
+        }
+
+        const Job& job;
+        const Options& options;
+        const std::vector<KeyEvent> events;
+        Chip8 reference;
+        Chip8 candidate;
+        uint64_t executed{};
+        size_t next_event{};
+};
+
+std::string hex(unsigned int value, int digits) {
+    char text[16];
+    snprintf(text, sizeof(text), "%0*x", digits, value);
+    return text;
+}
+
+//Lists the fields that differ between the reference and candidate snapshots
+//Program counter and stack are compared whole, bits above the memory size included, like StateHash does
+std::string describe(const Snapshot& expected, const Snapshot& actual) {
+    std::ostringstream out;
+    auto field = [&](const std::string& name, unsigned int want, unsigned int got, int digits) {
+        if (want != got) out << " " << name << " ref=" << hex(want, digits) << " got=" << hex(got, digits);
+    };
+
+    for (unsigned int i = 0; i < REG_COUNT; i++) field("V" + hex(i, 1), expected.registers[i], actual.registers[i], 2);
+    field("I", expected.memory_index, actual.memory_index, 3);
+    field("PC", expected.program_counter, actual.program_counter, 4);
+    field("SP", expected.stack_pointer, actual.stack_pointer, 1);
+    field("DT", expected.delay_timer, actual.delay_timer, 2);
+    field("ST", expected.sound_timer, actual.sound_timer, 2);
+    for (unsigned int i = 0; i < STACK_SIZE; i++) field("stack" + std::to_string(i), expected.stack[i], actual.stack[i], 4);
+
+    unsigned int bytes = 0;
+    for (unsigned int i = 0; i < XO_MEM_SIZE; i++) {
+        if (expected.memory[i] == actual.memory[i]) continue;
+        if (bytes++ == 0) field("mem[" + hex(i, 3) + "]", expected.memory[i], actual.memory[i], 2);
+    }
+    if (bytes > 1) out << " (" << bytes << " bytes of memory differ)";
+
+    if (memcmp(expected.video, actual.video, VIDEO_HEIGHT * sizeof(uint64_t)) != 0
+        || memcmp(expected.xvideo, actual.xvideo, sizeof(*expected.xvideo) * PLANE_COUNT) != 0) out << " display";
+    if (expected.rng.state != actual.rng.state) out << " rng";
+    if (memcmp(expected.flags, actual.flags, sizeof(expected.flags)) != 0) out << " flags";
+    if (expected.hires != actual.hires || expected.plane_mask != actual.plane_mask
+        || expected.pitch != actual.pitch || memcmp(expected.audio_pattern, actual.audio_pattern, sizeof(expected.audio_pattern)) != 0) {
+        out << " display-mode";
+    }
+    return out.str();
+}
+
+//Replays to the last matching check, then bisects the instruction count after it
+//Each probe reruns from the check with the same steps as the original run, only the last one
+//cut short. Engines that run several instructions as one unit (JIT and AOT blocks, fused
+//sequences) only do so when the whole unit fits in the budget, so the first differing count
+//is the end of the unit that went wrong, and the report lists the instructions leading to it
+std::string bisect(const Job& job, const Options& options, uint64_t matched, uint64_t mismatched) {
+    const unsigned int context = 8;
+    Session session(job, options);
+    session.advance(matched);
+
+    std::unique_ptr<Snapshot> reference_start(new Snapshot());
+    std::unique_ptr<Snapshot> candidate_start(new Snapshot());
+    session.reference.saveState(*reference_start);
+    session.candidate.saveState(*candidate_start);
+    size_t event = session.next_event;
+
+    uint64_t low = 0;
+    uint64_t high = mismatched - matched;
+    while (high - low > 1) {
+        uint64_t middle = low + (high - low) / 2;
+        session.restore(*reference_start, *candidate_start, matched, event);
+        session.advance(matched + middle);
+
+        if (StateHash::full(session.reference) != StateHash::full(session.candidate)) high = middle;
+        else low = middle;
+    }
+
+    std::unique_ptr<Snapshot> expected(new Snapshot());
+    std::unique_ptr<Snapshot> actual(new Snapshot());
+    session.restore(*reference_start, *candidate_start, matched, event);
+    session.advance(matched + high);
+    session.reference.saveState(*expected);
+    session.candidate.saveState(*actual);
+    std::string differences = describe(*expected, *actual);
+
+    //The reference doesn't depend on how its steps are split, so it can be walked one at a time
+    std::string trace;
+    unsigned int mask = (options.machine == Machine::XoChip ? XO_MEM_SIZE : MEM_SIZE) - 1;
+    uint64_t first = high > context ? high - context : 0;
+    session.restore(*reference_start, *candidate_start, matched, event);
+    session.advance(matched + first);
+    for (uint64_t position = first; position < high; position++) {
+        session.reference.saveState(*expected);
+        unsigned int pc = expected->program_counter & mask;
+        trace += " " + hex(pc, 3) + ":" + hex((expected->memory[pc] << 8u) | expected->memory[(pc + 1) & mask], 4);
+        session.advance(matched + position + 1);
+    }
+
+    return "DIVERGED after instruction " + std::to_string(matched + high) + ":" + differences + " | reference ran" + trace;
+}
+
+//LOCKSTEP_LANES lanes, lane l on seed + l with its own key presses, each beside a reference
+//Lanes see different keys and random numbers, so their opcodes diverge and run sorted by class
+class LockstepSession {
+    public:
+        static const unsigned int LOCKSTEP_LANES = 8;
+
+        LockstepSession(const Job& job, const Options& options) : options(options), lockstep(LOCKSTEP_LANES), references(LOCKSTEP_LANES) {
+            Quirks quirks = Quirks::defaults(options.machine);
+            parseQuirks(options.quirks, quirks);
+            Quirks drawing = Quirks::defaults(Machine::Chip8);
+            drawing.wrap = quirks.wrap;
+            //Lanes implement CHIP-8 with the default quirks, except for the edge handling of Dxyn
+            supported = options.machine == Machine::Chip8 && quirks == drawing;
+
+            std::shared_ptr<const RomImage> image = RomCache::global().load(job.program.data(), job.program.size());
+            supported = supported && image && lockstep.loadRom(*image);
+            lockstep.setDrawMode(quirks.wrap ? DrawMode::Wrap : DrawMode::Clip);
+
+            for (unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                Chip8& reference = references[lane];
+                reference.seed(job.seed + lane);
+                reference.loadRom(job.program.data(), job.program.size());
+                reference.setQuirks(quirks);
+                lockstep.seed(lane, job.seed + lane);
+                events.push_back(keyEvents(job.seed + lane, options.cycles));
+            }
+            next_event.assign(LOCKSTEP_LANES, 0);
+        }
+
+        bool available() const {
+            return supported;
+        }
+
+        //Every lane and reference runs one instruction at a time, timers tick and keys change between them
+        void advance(uint64_t target) {
+            while (executed < target) {
+                lockstep.cycle();
+                for (Chip8& reference : references) reference.cycle();
+                executed++;
+
+                if (executed % options.instructions_per_frame == 0) {
+                    lockstep.tickTimers();
+                    for (Chip8& reference : references) reference.tickTimers();
+                }
+                for (unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                    for (; next_event[lane] < events[lane].size() && events[lane][next_event[lane]].cycle == executed; next_event[lane]++) {
+                        const KeyEvent& event = events[lane][next_event[lane]];
+                        references[lane].keypad[event.key] = event.pressed;
+                        lockstep.keypad(lane)[event.key] = event.pressed;
+                    }
+                }
+            }
+        }
+
+        //First lane that differs from its reference and what differs, -1 if all match
+        int compare(std::string& differences) {
+            for (unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                references[lane].saveState(*expected);
+                lockstep.saveState(lane, *actual);
+                differences = describe(*expected, *actual);
+                if (!differences.empty()) return static_cast<int>(lane);
+            }
+            return -1;
+        }
+
+        const Options& options;
+        LockstepChip8 lockstep;
+        std::vector<Chip8> references;
+        std::vector<std::vector<KeyEvent>> events;
+        std::vector<size_t> next_event;
+        uint64_t executed{};
+        bool supported{};
+        std::unique_ptr<Snapshot> expected{new Snapshot()};
+        std::unique_ptr<Snapshot> actual{new Snapshot()};
+};
+
+//Compares every --check instructions, then replays from the last match one instruction at a time
+//The lanes can't be restored from snapshots, so the replay starts over
+std::string runLockstepJob(const Job& job, const Options& options, bool& skipped) {
+    std::unique_ptr<LockstepSession> session(new LockstepSession(job, options));
+    skipped = !session->available();
+    if (skipped) return "";
+
+    std::string differences;
+    uint64_t matched = 0;
+    while (session->executed < options.cycles) {
+        session->advance(std::min(session->executed + options.interval, options.cycles));
+        if (session->compare(differences) >= 0) break;
+        matched = session->executed;
+    }
+    if (matched == session->executed) return "";
+
+    session.reset(new LockstepSession(job, options));
+    session->advance(matched);
+    //Instructions each reference was about to run, the diverging lane's last 8 are reported
+    std::vector<std::vector<std::string>> traces(LockstepSession::LOCKSTEP_LANES);
+    int lane = -1;
+    while (lane < 0) {
+        for (unsigned int i = 0; i < LockstepSession::LOCKSTEP_LANES; i++) {
+            const Chip8& reference = session->references[i];
+            uint16_t pc = reference.getProgramCounter();
+            traces[i].push_back(" " + hex(pc & (MEM_SIZE - 1), 3) + ":" + hex((reference.getMemory(pc) << 8u) | reference.getMemory(pc + 1), 4));
+            if (traces[i].size() > 8) traces[i].erase(traces[i].begin());
+        }
+        session->advance(session->executed + 1);
+        lane = session->compare(differences);
+    }
+
+    std::string trace;
+    for (const std::string& step : traces[lane]) trace += step;
+    return "lane=" + std::to_string(lane) + " (seed " + std::to_string(job.seed + lane) + ") DIVERGED after instruction "
+        + std::to_string(session->executed) + ":" + differences + " | reference ran" + trace;
+}
+
+//Returns an empty string if the candidate matched the reference for the whole run
+std::string runJob(const Job& job, const Options& options, bool& skipped) {
+    if (job.lockstep) return runLockstepJob(job, options, skipped);
+
+    Session session(job, options);
+    skipped = !session.available();
+    if (skipped) return "";
+
+    StateHash reference_hash(session.reference);
+    StateHash candidate_hash(session.candidate);
+
+    uint64_t matched = 0;
+    while (session.executed < options.cycles) {
+        session.advance(std::min(session.executed + options.interval, options.cycles));
+        if (reference_hash.update() != candidate_hash.update()) return bisect(job, options, matched, session.executed);
+        matched = session.executed;
+    }
+
+    //Incremental hashes only see writes the machines report, so check them against a full rehash
+    if (reference_hash.update() != StateHash::full(session.reference) || candidate_hash.update() != StateHash::full(session.candidate)) {
+        return "HASH TRACKING missed a write, incremental and full state hashes differ";
+    }
+    return "";
+}
+
+//Random bytes, with the same generator as Cxkk so runs are reproducible everywhere
+std::vector<uint8_t> fuzzProgram(uint32_t index, size_t size) {
+    Rng rng;
+    rng.seed(index ^ 0x46555A5Au);
+    std::vector<uint8_t> program(size);
+    for (uint8_t& byte : program) byte = rng.nextByte();
+    return program;
+}
+
+void usage(const char* program) {
+    std::cerr << "Usage: " << program << " [--engine interpreter|jit|specialized|aot|lockstep] [--cycles N] [--ipf N] [--check N] [--seeds N] [--threads N] [--schip | --xochip] [--quirks list] (--fuzz N [--size bytes] | <ROM>...)\n";
+    std::exit(EXIT_FAILURE);
+}
+
+Engine parseEngine(const std::string& name, const char* program) {
+    if (name == "interpreter") return Engine::Interpreter;
+    if (name == "jit") return Engine::Jit;
+    if (name == "specialized") return Engine::Specialized;
+    if (name == "aot") return Engine::Aot;
+    usage(program);
+    return Engine::Interpreter;
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--engine" && has_value) {
+            std::string engine = argv[++i];
+            options.lockstep = engine == "lockstep";
+            options.engines.clear();
+            if (!options.lockstep) options.engines.push_back(parseEngine(engine, argv[0]));
+        }
+        else if (arg == "--cycles" && has_value) options.cycles = std::stoull(argv[++i]);
+        else if (arg == "--ipf" && has_value) options.instructions_per_frame = std::max(1ull, std::stoull(argv[++i]));
+        else if (arg == "--check" && has_value) options.interval = std::max(1ull, std::stoull(argv[++i]));
+        else if (arg == "--seeds" && has_value) options.seeds = std::stoul(argv[++i]);
+        else if (arg == "--threads" && has_value) options.threads = std::stoul(argv[++i]);
+        else if (arg == "--fuzz" && has_value) options.fuzz = std::stoul(argv[++i]);
+        else if (arg == "--size" && has_value) options.fuzz_size = std::max(2ul, std::stoul(argv[++i]));
+        else if (arg == "--schip") options.machine = Machine::SuperChip;
+        else if (arg == "--xochip") options.machine = Machine::XoChip;
+        else if (arg == "--quirks" && has_value) options.quirks = argv[++i];
+        else if (arg.rfind("--", 0) == 0) usage(argv[0]);
+        else options.roms.push_back(arg);
+    }
+    if (options.roms.empty() == (options.fuzz == 0)) usage(argv[0]);
+    Quirks quirks;
+    if (!options.quirks.empty() && !parseQuirks(options.quirks, quirks)) usage(argv[0]);
+    size_t limit = (options.machine == Machine::XoChip ? XO_MEM_SIZE : MEM_SIZE) - START_ADDRESS;
+    options.fuzz_size = std::min(options.fuzz_size, limit);
+
+    std::vector<Job> jobs;
+    for (const std::string& rom : options.roms) {
+        RomError error = RomError::None;
+        std::shared_ptr<const RomImage> image = RomCache::global().load(rom, &error);
+        if (!image) {
+            std::cerr << "Could not load " << rom << ": " << romErrorString(error) << "\n";
+            return EXIT_FAILURE;
+        }
+        if (image->size > limit) {
+            std::cerr << rom << " is larger than " << limit << " bytes, run it with --xochip\n";
+            return EXIT_FAILURE;
+        }
+        for (uint32_t seed = 0; seed < options.seeds; seed++) {
+            for (Engine engine : options.engines) jobs.push_back({rom, image->program, seed, engine, false});
+            if (options.lockstep) jobs.push_back({rom, image->program, seed, Engine::Interpreter, true});
+        }
+    }
+    for (uint32_t index = 0; index < options.fuzz; index++) {
+        std::vector<uint8_t> program = fuzzProgram(index, options.fuzz_size);
+        for (Engine engine : options.engines) jobs.push_back({"fuzz#" + std::to_string(index), program, index, engine, false});
+        if (options.lockstep) jobs.push_back({"fuzz#" + std::to_string(index), program, index, Engine::Interpreter, true});
+    }
+
+    std::vector<std::string> results(jobs.size());
+    std::unique_ptr<bool[]> skipped(new bool[jobs.size()]());
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(options.threads);
+        for (size_t i = 0; i < jobs.size(); i++) {
+            pool.submit([&, i] { results[i] = runJob(jobs[i], options, skipped[i]); });
+        }
+        pool.wait();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t runs = 0;
+    size_t failures = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (skipped[i]) continue;
+        runs++;
+        if (results[i].empty()) continue;
+        failures++;
+        std::cout << jobs[i].name << " seed=" << jobs[i].seed << " engine=" << engineName(jobs[i]) << " " << results[i] << "\n";
+    }
+
+    std::cout << runs << " runs of " << options.cycles << " instructions, " << failures << " diverged, "
+        << jobs.size() - runs << " skipped (engine not available), " << seconds << "s ("
+        << (seconds > 0 ? runs * 60.0 / seconds : 0.0) << " runs/min)\n";
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+
+//Packed 1-bit-per-pixel framebuffer helpers
+//Each row is one uint64_t, most significant bit is x = 0
+//The SCHIP/XO-CHIP display is 128x64 with two words per row (word 0 holds x 0-63)
+//and one such buffer per bitplane
+
+const unsigned int HIRES_WIDTH = 128;
+const unsigned int HIRES_HEIGHT = 64;
+const unsigned int PLANE_COUNT = 2;
+
+//How sprites crossing the screen edge are handled
+enum class DrawMode {
+    Clip,   //Pixels past the right/bottom edge are dropped
+    Wrap    //Pixels past the right/bottom edge reappear on the left/top
+};
+
+//XORs an 8-pixel sprite row into a packed row at column xpos (0-63)
+//Returns true if any lit pixel was turned off (collision)
+inline bool drawSpriteRow(uint64_t& row, uint8_t sprite, unsigned int xpos, DrawMode mode) {
+    uint64_t bits = static_cast<uint64_t>(sprite) << 56;
+
+    if (mode == DrawMode::Wrap) bits = xpos ? (bits >> xpos) | (bits << (64 - xpos)) : bits;
+    else bits >>= xpos;
+
+    bool collision = (row & bits) != 0;
+    row ^= bits;
+    return collision;
+}
+
+//Expands packed rows into RGBA8888 pixels (lit = 0xFFFFFFFF, unlit = 0)
+inline void expandRows(const uint64_t* rows, unsigned int first, unsigned int count, uint32_t* pixels, unsigned int width) {
+    for (unsigned int y = first; y < first + count; y++) {
+        uint64_t row = rows[y];
+        uint32_t* out = &pixels[y * width];
+        for (unsigned int x = 0; x < width; x++) {
+            out[x] = 0u - static_cast<uint32_t>((row >> (63 - x)) & 1u);
+        }
+    }
+}
+
+//FNV-1a over packed rows, used to compare framebuffers across runs
+inline uint64_t hashRows(const uint64_t* rows, unsigned int count) {
+    uint64_t hash = 14695981039346656037ull;
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(rows);
+
+    for (unsigned int i = 0; i < count * sizeof(uint64_t); i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+//XORs up to 16 sprite pixels (bit 15 = leftmost) into a 128-pixel row at column xpos (0-127)
+//Returns true if any lit pixel was turned off (collision)
+inline bool drawWideRow(uint64_t* row, uint16_t sprite, unsigned int xpos, DrawMode mode) {
+    uint64_t bits = static_cast<uint64_t>(sprite) << 48;
+    uint64_t left = xpos < 64 ? bits >> xpos : 0;
+    uint64_t right = xpos == 0 ? 0 : xpos < 64 ? bits << (64 - xpos) : bits >> (xpos - 64);
+
+    //Pixels past x = 127 come back in at x = 0
+    if (mode == DrawMode::Wrap && xpos > HIRES_WIDTH - 16) left |= bits << (HIRES_WIDTH - xpos);
+
+    bool collision = (row[0] & left) || (row[1] & right);
+    row[0] ^= left;
+    row[1] ^= right;
+    return collision;
+}
+
+//Shifts every row of a 128x64 plane by whole words: positive dx moves right, positive dy moves down
+//Pixels shifted out are lost and vacated pixels are cleared
+inline void scrollPlane(uint64_t (*rows)[2], int dx, int dy) {
+    if (dy > 0) {
+        for (int y = HIRES_HEIGHT - 1; y >= 0; y--) {
+            rows[y][0] = y >= dy ? rows[y - dy][0] : 0;
+            rows[y][1] = y >= dy ? rows[y - dy][1] : 0;
+        }
+    }
+    else if (dy < 0) {
+        for (int y = 0; y < static_cast<int>(HIRES_HEIGHT); y++) {
+            rows[y][0] = y - dy < static_cast<int>(HIRES_HEIGHT) ? rows[y - dy][0] : 0;
+            rows[y][1] = y - dy < static_cast<int>(HIRES_HEIGHT) ? rows[y - dy][1] : 0;
+        }
+    }
+
+    //Horizontal scrolls are at most 8 pixels, one funnel shift across the word pair
+    if (dx > 0) {
+        for (unsigned int y = 0; y < HIRES_HEIGHT; y++) {
+            rows[y][1] = (rows[y][1] >> dx) | (rows[y][0] << (64 - dx));
+            rows[y][0] >>= dx;
+        }
+    }
+    else if (dx < 0) {
+        for (unsigned int y = 0; y < HIRES_HEIGHT; y++) {
+            rows[y][0] = (rows[y][0] << -dx) | (rows[y][1] >> (64 + dx));
+            rows[y][1] <<= -dx;
+        }
+    }
+}
+
+//Expands 128x64 planes into RGBA8888 pixels, palette is indexed by (plane 1 bit << 1) | plane 0 bit
+inline void expandWideRows(const uint64_t (*planes)[HIRES_HEIGHT][2], unsigned int first, unsigned int count, uint32_t* pixels, const uint32_t* palette) {
+    for (unsigned int y = first; y < first + count; y++) {
+        uint32_t* out = &pixels[y * HIRES_WIDTH];
+        for (unsigned int x = 0; x < HIRES_WIDTH; x++) {
+            unsigned int word = x >> 6;
+            unsigned int shift = 63 - (x & 63);
+            unsigned int color = ((planes[0][y][word] >> shift) & 1u) | (((planes[1][y][word] >> shift) & 1u) << 1);
+            out[x] = palette[color];
+        }
+    }
+}
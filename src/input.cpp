@@ -0,0 +1,92 @@
+#include "input.hpp"
+#include <chrono>
+
+uint64_t inputTimestamp() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+InputRing::InputRing(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+
+    events.resize(size);
+    mask = size - 1;
+}
+
+bool InputRing::push(const InputEvent& event) {
+    size_t write = head.load(std::memory_order_relaxed);
+    if (write - tail.load(std::memory_order_acquire) == events.size()) {
+        dropped_events.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    events[write & mask] = event;
+    head.store(write + 1, std::memory_order_release);
+    return true;
+}
+
+bool InputRing::peek(InputEvent& event) const {
+    size_t read = tail.load(std::memory_order_relaxed);
+    if (read == head.load(std::memory_order_acquire)) return false;
+
+    event = events[read & mask];
+    return true;
+}
+
+bool InputRing::pop(InputEvent& event) {
+    if (!peek(event)) return false;
+
+    tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    return true;
+}
+
+uint64_t InputRing::dropped() const {
+    return dropped_events.load(std::memory_order_relaxed);
+}
+
+void LatencyStats::record(uint64_t nanoseconds) {
+    uint64_t microseconds = nanoseconds / 1000;
+    unsigned int bucket = 0;
+    while (bucket < BUCKETS - 1 && (1ull << bucket) <= microseconds) bucket++;
+
+    buckets[bucket]++;
+    samples++;
+    total_ns += nanoseconds;
+    if (nanoseconds > max_ns) max_ns = nanoseconds;
+}
+
+uint64_t LatencyStats::count() const {
+    return samples;
+}
+
+double LatencyStats::meanMicroseconds() const {
+    return samples ? total_ns / 1000.0 / samples : 0.0;
+}
+
+uint64_t LatencyStats::maxMicroseconds() const {
+    return max_ns / 1000;
+}
+
+//Bucket b holds samples below 2^b microseconds
+uint64_t LatencyStats::percentileMicroseconds(double fraction) const {
+    uint64_t target = static_cast<uint64_t>(fraction * samples);
+    uint64_t seen = 0;
+
+    for (unsigned int bucket = 0; bucket < BUCKETS; bucket++) {
+        seen += buckets[bucket];
+        if (seen > target) return 1ull << bucket;
+    }
+    return 1ull << (BUCKETS - 1);
+}
+
+void LatencyStats::print(FILE* out, const char* name) const {
+    if (!samples) {
+        fprintf(out, "%s: no samples\n", name);
+        return;
+    }
+    fprintf(out, "%s: %llu samples, mean %.0f us, p50 < %llu us, p99 < %llu us, max %llu us\n", name,
+        static_cast<unsigned long long>(samples), meanMicroseconds(),
+        static_cast<unsigned long long>(percentileMicroseconds(0.5)),
+        static_cast<unsigned long long>(percentileMicroseconds(0.99)),
+        static_cast<unsigned long long>(maxMicroseconds()));
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+//Keypad transition stamped with the host time it was read
+struct InputEvent {
+    uint64_t timestamp; //steady_clock nanoseconds, see inputTimestamp()
+    uint8_t key;
+    uint8_t pressed;
+};
+
+uint64_t inputTimestamp();
+
+//Single-producer single-consumer lock-free ring of input events
+//The platform thread pushes and the emulation thread pops; neither side ever blocks
+class InputRing {
+    public:
+        //Capacity is rounded up to a power of two
+        explicit InputRing(size_t capacity = 256);
+
+        //Returns false and drops the event if the ring is full
+        bool push(const InputEvent& event);
+        //Consumer side: peek looks at the oldest event without removing it
+        bool peek(InputEvent& event) const;
+        bool pop(InputEvent& event);
+
+        uint64_t dropped() const;
+
+    private:
+        std::vector<InputEvent> events;
+        size_t mask;
+
+        //Free-running indices, each written by one side only, kept on separate cache lines
+        alignas(64) std::atomic<size_t> head{0};
+        alignas(64) std::atomic<size_t> tail{0};
+        alignas(64) std::atomic<uint64_t> dropped_events{0};
+};
+
+//Latency distribution in power-of-two microsecond buckets
+class LatencyStats {
+    public:
+        void record(uint64_t nanoseconds);
+
+        uint64_t count() const;
+        double meanMicroseconds() const;
+        uint64_t maxMicroseconds() const;
+        //Upper bound of the bucket holding the given fraction of samples, in microseconds
+        uint64_t percentileMicroseconds(double fraction) const;
+
+        void print(FILE* out, const char* name) const;
+
+    private:
+        static const unsigned int BUCKETS = 32;
+
+        uint64_t buckets[BUCKETS]{};
+        uint64_t samples{};
+        uint64_t total_ns{};
+        uint64_t max_ns{};
+};
@@ -0,0 +1,279 @@
+#include "jit.hpp"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHIP8_JIT_X64 1
+#endif
+
+    const size_t code_buffer_size = 1 << 20;
+    //Largest possible block, flush before compiling if less than this is left
+    const size_t max_block_bytes = 2048;
+    const unsigned int max_block_length = 32;
+
+Jit::Jit(Chip8& chip8)
+    :chip8(chip8) {
+
+#if defined(CHIP8_JIT_X64)
+#if defined(_WIN32)
+    code_buffer = static_cast<uint8_t*>(VirtualAlloc(nullptr, code_buffer_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+#else
+    //Never writable and executable at once, see protect()
+    void* mapping = mmap(nullptr, code_buffer_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping != MAP_FAILED) code_buffer = static_cast<uint8_t*>(mapping);
+#endif
+#endif
+}
+
+Jit::~Jit() {
+    release();
+}
+
+void Jit::release() {
+    if (!code_buffer) return;
+#if defined(_WIN32)
+    VirtualFree(code_buffer, 0, MEM_RELEASE);
+#else
+    munmap(code_buffer, code_buffer_size);
+#endif
+    code_buffer = nullptr;
+}
+
+//W^X: the buffer is read/write while compiling and read/execute while blocks run
+//Returns false if the protection couldn't be changed
+bool Jit::protect(bool executable) {
+    if (executable == this->executable) return true;
+#if defined(_WIN32)
+    DWORD previous;
+    if (!VirtualProtect(code_buffer, code_buffer_size, executable ? PAGE_EXECUTE_READ : PAGE_READWRITE, &previous)) return false;
+    if (executable) FlushInstructionCache(GetCurrentProcess(), code_buffer, code_buffer_size);
+#else
+    if (mprotect(code_buffer, code_buffer_size, executable ? PROT_READ | PROT_EXEC : PROT_READ | PROT_WRITE) != 0) return false;
+#endif
+    this->executable = executable;
+    return true;
+}
+
+bool Jit::available() {
+#if defined(CHIP8_JIT_X64)
+    return true;
+#else
+    return false;
+#endif
+}
+
+//Runs compiled block at program counter, compiling it on first visit
+//Falls back to a single interpreted cycle if no code buffer could be mapped or protected
+unsigned int Jit::run(unsigned int budget) {
+    if (!code_buffer) {
+        chip8.cycle();
+        return 1;
+    }
+
+    uint16_t address = chip8.program_counter & (MEM_SIZE - 1);
+    Block& block = blocks[address];
+    if (!block.code) {
+        if (!protect(false)) {
+            release();
+            chip8.cycle();
+            return 1;
+        }
+        block = compile(address);
+    }
+
+    if (block.length > budget) {
+        chip8.cycle();
+        return 1;
+    }
+    if (!protect(true)) {
+        release();
+        chip8.cycle();
+        return 1;
+    }
+
+    //Length is read first, a block that writes into compiled code flushes the table it lives in
+    unsigned int length = block.length;
+    block.code();
+    return length;
+}
+
+//Self-modifying code: any write into a compiled range throws away the whole cache
+void Jit::invalidate(uint16_t address, uint16_t length) {
+    for (unsigned int i = 0; i < length; i++) {
+        if (code_map[(address + i) & (MEM_SIZE - 1)]) {
+            flush();
+            return;
+        }
+    }
+}
+
+//Code buffer is only reset, never unmapped, so a block that triggered the flush can still return
+void Jit::flush() {
+    memset(blocks, 0, sizeof(blocks));
+    memset(code_map, 0, sizeof(code_map));
+    code_used = 0;
+}
+
+void Jit::emit8(uint8_t value) {
+    code_buffer[code_used++] = value;
+}
+
+void Jit::emit16(uint16_t value) {
+    memcpy(&code_buffer[code_used], &value, sizeof(value));
+    code_used += sizeof(value);
+}
+
+void Jit::emit32(uint32_t value) {
+    memcpy(&code_buffer[code_used], &value, sizeof(value));
+    code_used += sizeof(value);
+}
+
+void Jit::emit64(uint64_t value) {
+    memcpy(&code_buffer[code_used], &value, sizeof(value));
+    code_used += sizeof(value);
+}
+
+//Displacement of a Chip8 field from the object, used as [rbx + disp32]
+int32_t Jit::offsetOf(const void* field) const {
+    return static_cast<int32_t>(static_cast<const uint8_t*>(field) - reinterpret_cast<const uint8_t*>(&chip8));
+}
+
+//mov byte [rbx + disp32], imm8
+void Jit::emitStoreByte(const void* field, uint8_t value) {
+    emit8(0xC6); emit8(0x83); emit32(offsetOf(field)); emit8(value);
+}
+
+//mov word [rbx + disp32], imm16
+void Jit::emitStoreWord(const void* field, uint16_t value) {
+    emit8(0x66); emit8(0xC7); emit8(0x83); emit32(offsetOf(field)); emit16(value);
+}
+
+//add word [rbx + disp32], imm16
+void Jit::emitAddWord(const void* field, uint16_t value) {
+    emit8(0x66); emit8(0x81); emit8(0x83); emit32(offsetOf(field)); emit16(value);
+}
+
+//callHandler(chip8, entry) using the host calling convention
+void Jit::emitCall(const Instruction* entry) {
+#if defined(_WIN32)
+    emit8(0x48); emit8(0x89); emit8(0xD9);      //mov rcx, rbx
+    emit8(0x48); emit8(0xBA);                   //mov rdx, imm64
+#else
+    emit8(0x48); emit8(0x89); emit8(0xDF);      //mov rdi, rbx
+    emit8(0x48); emit8(0xBE);                   //mov rsi, imm64
+#endif
+    emit64(reinterpret_cast<uint64_t>(entry));
+    emit8(0x48); emit8(0xB8);                   //mov rax, imm64
+    emit64(reinterpret_cast<uint64_t>(&Jit::callHandler));
+    emit8(0xFF); emit8(0xD0);                   //call rax
+}
+
+void Jit::callHandler(Chip8* chip8, const Instruction* entry) {
+    chip8->inst = entry;
+    ( (*chip8).*(Chip8::handlers[entry->base]) )();
+}
+
+//Translates instructions starting at address until a control-flow change
+//Blocks end at jumps, calls, returns, skips, Fx0A, and Fx33/Fx55 (may overwrite code)
+Jit::Block Jit::compile(uint16_t address) {
+    if (code_used + max_block_bytes > code_buffer_size) flush();
+
+    Block block{};
+    block.code = reinterpret_cast<BlockFunc>(&code_buffer[code_used]);
+
+    emit8(0x53);                                                //push rbx
+#if defined(_WIN32)
+    emit8(0x48); emit8(0x83); emit8(0xEC); emit8(0x20);         //sub rsp, 32 (shadow space)
+#endif
+    emit8(0x48); emit8(0xBB); emit64(reinterpret_cast<uint64_t>(&chip8)); //mov rbx, imm64
+
+    //Blocks are keyed by the masked address, but the interpreter lets program counter run past
+    //the end of memory, so it is advanced by offsets from its value on entry instead of stored
+    uint16_t pc = address;
+    uint16_t pc_stored = address;
+    bool pc_written = false;
+    bool done = false;
+
+    while (!done) {
+        Instruction& entry = chip8.decoded(pc);
+        if (entry.handler == Chip8::OP_DECODE) chip8.decode(entry, pc);
+
+        code_map[pc] = 1;
+        code_map[(pc + 1) & (MEM_SIZE - 1)] = 1;
+        uint16_t next = pc + 2;
+        pc_written = false;
+
+        //Compiled code handles sequences itself, fused handlers are interpreter-only
+        switch (entry.base) {
+            case Chip8::OP_6XKK:
+                emitStoreByte(&chip8.registers[entry.x], entry.kk);
+                break;
+            case Chip8::OP_7XKK:
+                //add byte [rbx + disp32], imm8
+                emit8(0x80); emit8(0x83); emit32(offsetOf(&chip8.registers[entry.x])); emit8(entry.kk);
+                break;
+            case Chip8::OP_8XY0:
+            case Chip8::OP_8XY1:
+            case Chip8::OP_8XY2:
+            case Chip8::OP_8XY3: {
+                //mov al, [rbx + Vy] then mov/or/and/xor [rbx + Vx], al
+                const uint8_t ops[] = {0x88, 0x08, 0x20, 0x30};
+                emit8(0x8A); emit8(0x83); emit32(offsetOf(&chip8.registers[entry.y]));
+                emit8(ops[entry.base - Chip8::OP_8XY0]); emit8(0x83); emit32(offsetOf(&chip8.registers[entry.x]));
+                break;
+            }
+            case Chip8::OP_ANNN:
+                emitStoreWord(&chip8.memory_index, entry.nnn);
+                break;
+            case Chip8::OP_NULL:
+                break;
+            default:
+                //Handlers expect program counter already advanced, as in cycle()
+                emitAddWord(&chip8.program_counter, next - pc_stored);
+                pc_stored = next;
+                emitCall(&entry);
+                pc_written = true;
+                break;
+        }
+
+        block.length++;
+
+        switch (entry.base) {
+            case Chip8::OP_00EE:
+            case Chip8::OP_1NNN:
+            case Chip8::OP_2NNN:
+            case Chip8::OP_BNNN:
+            case Chip8::OP_BXNN:
+            case Chip8::OP_3XKK:
+            case Chip8::OP_4XKK:
+            case Chip8::OP_5XY0:
+            case Chip8::OP_9XY0:
+            case Chip8::OP_EX9E:
+            case Chip8::OP_EXA1:
+            case Chip8::OP_FX0A:
+            case Chip8::OP_FX33:
+            case Chip8::OP_FX55:
+            case Chip8::OP_FX55_I:
+                done = true;
+                break;
+        }
+
+        if (block.length == max_block_length || next > MEM_SIZE - 2) done = true;
+        pc = next;
+    }
+
+    //Inline ops don't touch program counter, so advance it to the fall-through address
+    if (!pc_written) emitAddWord(&chip8.program_counter, pc - pc_stored);
+
+#if defined(_WIN32)
+    emit8(0x48); emit8(0x83); emit8(0xC4); emit8(0x20);         //add rsp, 32
+#endif
+    emit8(0x5B);                                                //pop rbx
+    emit8(0xC3);                                                //ret
+
+    return block;
+}
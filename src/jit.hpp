@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "chip8.hpp"
+
+//Basic-block recompiler for x86-64
+//Translates runs of CHIP-8 instructions into native code, one block per start address
+//Simple register ops are emitted inline, everything else calls back into the interpreter handlers
+class Jit {
+    public:
+        explicit Jit(Chip8& chip8);
+        ~Jit();
+
+        //True if this build/host can run generated code
+        static bool available();
+
+        //Runs block at current program counter, returns number of instructions executed
+        //Falls back to one interpreted cycle if the block is longer than budget
+        unsigned int run(unsigned int budget);
+
+        //Drops compiled code if memory[address, address + length) is part of a block
+        void invalidate(uint16_t address, uint16_t length);
+        void flush();
+
+    private:
+        typedef void (*BlockFunc)();
+
+        struct Block {
+            BlockFunc code;
+            uint8_t length;
+        };
+
+        Chip8& chip8;
+
+        Block blocks[MEM_SIZE]{};
+        //Marks addresses covered by a compiled block, checked on memory writes
+        uint8_t code_map[MEM_SIZE]{};
+
+        uint8_t* code_buffer{};
+        size_t code_used{};
+        bool executable{};
+
+        Block compile(uint16_t address);
+        bool protect(bool executable);
+        void release();
+
+        //Emitters
+        void emit8(uint8_t value);
+        void emit16(uint16_t value);
+        void emit32(uint32_t value);
+        void emit64(uint64_t value);
+        int32_t offsetOf(const void* field) const;
+        void emitStoreByte(const void* field, uint8_t value);
+        void emitStoreWord(const void* field, uint16_t value);
+        void emitAddWord(const void* field, uint16_t value);
+        void emitCall(const Instruction* entry);
+
+        static void callHandler(Chip8* chip8, const Instruction* entry);
+};
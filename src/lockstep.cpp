@@ -0,0 +1,511 @@
+#include "lockstep.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+//Byte vector used by the lane kernels
+//Lane arrays are padded to LANE_ALIGN so kernels never need a scalar tail
+const size_t LANE_ALIGN = 32;
+
+#if defined(__AVX2__)
+struct Vec {
+    typedef __m256i Type;
+    static const size_t width = 32;
+    static Type load(const uint8_t* p) { return _mm256_loadu_si256(reinterpret_cast<const Type*>(p)); }
+    static void store(uint8_t* p, Type v) { _mm256_storeu_si256(reinterpret_cast<Type*>(p), v); }
+    static Type set1(uint8_t v) { return _mm256_set1_epi8(static_cast<char>(v)); }
+    static Type add(Type a, Type b) { return _mm256_add_epi8(a, b); }
+    static Type sub(Type a, Type b) { return _mm256_sub_epi8(a, b); }
+    static Type subs(Type a, Type b) { return _mm256_subs_epu8(a, b); }
+    static Type bitAnd(Type a, Type b) { return _mm256_and_si256(a, b); }
+    static Type bitOr(Type a, Type b) { return _mm256_or_si256(a, b); }
+    static Type bitXor(Type a, Type b) { return _mm256_xor_si256(a, b); }
+    static Type eq(Type a, Type b) { return _mm256_cmpeq_epi8(a, b); }
+    //Unsigned a > b via signed compare after flipping the sign bit
+    static Type gt(Type a, Type b) { return _mm256_cmpgt_epi8(bitXor(a, set1(0x80)), bitXor(b, set1(0x80))); }
+    static Type blend(Type m, Type a, Type b) { return _mm256_blendv_epi8(b, a, m); }
+};
+#elif defined(__SSE2__)
+struct Vec {
+    typedef __m128i Type;
+    static const size_t width = 16;
+    static Type load(const uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const Type*>(p)); }
+    static void store(uint8_t* p, Type v) { _mm_storeu_si128(reinterpret_cast<Type*>(p), v); }
+    static Type set1(uint8_t v) { return _mm_set1_epi8(static_cast<char>(v)); }
+    static Type add(Type a, Type b) { return _mm_add_epi8(a, b); }
+    static Type sub(Type a, Type b) { return _mm_sub_epi8(a, b); }
+    static Type subs(Type a, Type b) { return _mm_subs_epu8(a, b); }
+    static Type bitAnd(Type a, Type b) { return _mm_and_si128(a, b); }
+    static Type bitOr(Type a, Type b) { return _mm_or_si128(a, b); }
+    static Type bitXor(Type a, Type b) { return _mm_xor_si128(a, b); }
+    static Type eq(Type a, Type b) { return _mm_cmpeq_epi8(a, b); }
+    static Type gt(Type a, Type b) { return _mm_cmpgt_epi8(bitXor(a, set1(0x80)), bitXor(b, set1(0x80))); }
+    static Type blend(Type m, Type a, Type b) { return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b)); }
+};
+#else
+//Portable fallback, one lane per "vector"
+struct Vec {
+    typedef uint8_t Type;
+    static const size_t width = 1;
+    static Type load(const uint8_t* p) { return *p; }
+    static void store(uint8_t* p, Type v) { *p = v; }
+    static Type set1(uint8_t v) { return v; }
+    static Type add(Type a, Type b) { return a + b; }
+    static Type sub(Type a, Type b) { return a - b; }
+    static Type subs(Type a, Type b) { return a > b ? a - b : 0; }
+    static Type bitAnd(Type a, Type b) { return a & b; }
+    static Type bitOr(Type a, Type b) { return a | b; }
+    static Type bitXor(Type a, Type b) { return a ^ b; }
+    static Type eq(Type a, Type b) { return a == b ? 0xFF : 0; }
+    static Type gt(Type a, Type b) { return a > b ? 0xFF : 0; }
+    static Type blend(Type m, Type a, Type b) { return (m & a) | (~m & b); }
+};
+#endif
+
+typedef Vec::Type V;
+
+//Masked write: dst = mask ? value : dst
+inline void storeMasked(uint8_t* dst, const uint8_t* mask, V value) {
+    Vec::store(dst, Vec::blend(Vec::load(mask), value, Vec::load(dst)));
+}
+
+}
+
+LockstepChip8::LockstepChip8(size_t lanes)
+    :lanes(lanes),
+    padded((lanes + LANE_ALIGN - 1) / LANE_ALIGN * LANE_ALIGN),
+    registers(REG_COUNT * padded),
+    program_counter(padded, START_ADDRESS),
+    memory_index(padded),
+    stack_pointer(padded),
+    delay_timer(padded),
+    sound_timer(padded),
+    memory(lanes * MEM_SIZE),
+    stack(lanes * STACK_SIZE),
+    video(lanes * VIDEO_HEIGHT),
+    keys(lanes * KEY_COUNT),
+    rngs(lanes),
+    active(padded),
+    opcodes(padded),
+    order(lanes),
+    scratch(padded) {
+
+    memset(active.data(), 0xFF, lanes);
+
+    for (size_t lane = 0; lane < lanes; lane++) {
+        memcpy(&memory[lane * MEM_SIZE + FONTSET_START_ADDRESS], FONTSET, FONTSET_SIZE);
+    }
+}
+
+size_t LockstepChip8::size() const {
+    return lanes;
+}
+
+bool LockstepChip8::loadRom(const char* filename) {
+    std::shared_ptr<const RomImage> image = RomCache::global().load(filename);
+    if (!image) return false;
+
+    return loadRom(*image);
+}
+
+bool LockstepChip8::loadRom(const RomImage& image) {
+    if (image.size > MEM_SIZE - START_ADDRESS) return false;
+
+    for (size_t lane = 0; lane < lanes; lane++) {
+        memcpy(&memory[lane * MEM_SIZE], image.memory, MEM_SIZE);
+    }
+    return true;
+}
+
+void LockstepChip8::seed(size_t lane, uint32_t value) {
+    rngs[lane].seed(value);
+}
+
+uint8_t* LockstepChip8::keypad(size_t lane) {
+    return &keys[lane * KEY_COUNT];
+}
+
+uint8_t* LockstepChip8::reg(unsigned int index) {
+    return &registers[index * padded];
+}
+
+uint8_t LockstepChip8::getRegister(size_t lane, unsigned int index) const {
+    return registers[(index & 0xFu) * padded + lane];
+}
+
+uint16_t LockstepChip8::getProgramCounter(size_t lane) const {
+    return program_counter[lane];
+}
+
+uint16_t LockstepChip8::getIndex(size_t lane) const {
+    return memory_index[lane];
+}
+
+void LockstepChip8::saveState(size_t lane, Snapshot& snapshot) const {
+    snapshot = Snapshot();
+    snapshot.version = Snapshot::VERSION;
+    snapshot.machine = Machine::Chip8;
+    snapshot.plane_mask = 1;
+    snapshot.pitch = 64;
+    for (unsigned int i = 0; i < REG_COUNT; i++) snapshot.registers[i] = registers[i * padded + lane];
+    memcpy(snapshot.memory, &memory[lane * MEM_SIZE], MEM_SIZE);
+    memcpy(snapshot.stack, &stack[lane * STACK_SIZE], sizeof(snapshot.stack));
+    snapshot.memory_index = memory_index[lane];
+    snapshot.program_counter = program_counter[lane];
+    snapshot.stack_pointer = stack_pointer[lane];
+    snapshot.delay_timer = delay_timer[lane];
+    snapshot.sound_timer = sound_timer[lane];
+    memcpy(snapshot.keypad, &keys[lane * KEY_COUNT], sizeof(snapshot.keypad));
+    memcpy(snapshot.video, &video[lane * VIDEO_HEIGHT], sizeof(snapshot.video));
+    snapshot.rng = rngs[lane];
+}
+
+void LockstepChip8::getVideo(size_t lane, uint32_t* pixels) const {
+    expandRows(&video[lane * VIDEO_HEIGHT], 0, VIDEO_HEIGHT, pixels, VIDEO_WIDTH);
+}
+
+const uint64_t* LockstepChip8::getRows(size_t lane) const {
+    return &video[lane * VIDEO_HEIGHT];
+}
+
+void LockstepChip8::setDrawMode(DrawMode mode) {
+    draw_mode = mode;
+}
+
+//Fetch-Decode-Execute for all lanes
+//When every lane fetched the same opcode it runs once across all lanes as a vector kernel,
+//otherwise lanes are sorted by top nibble and each class runs over its lanes in turn
+void LockstepChip8::cycle() {
+    uint16_t diverged = 0;
+    for (size_t lane = 0; lane < lanes; lane++) {
+        const uint8_t* lane_memory = &memory[lane * MEM_SIZE];
+        uint16_t pc = program_counter[lane] & (MEM_SIZE - 1);
+        opcodes[lane] = (lane_memory[pc] << 8u) | lane_memory[(pc + 1) & (MEM_SIZE - 1)];
+        program_counter[lane] += 2;
+        diverged |= opcodes[lane] ^ opcodes[0];
+    }
+
+    if (!diverged) {
+        if (!executeVector(opcodes[0])) {
+            for (size_t lane = 0; lane < lanes; lane++) executeLane(lane, opcodes[0]);
+        }
+        return;
+    }
+
+    //Counting sort, lanes running the same kind of instruction go back to back so branches predict
+    size_t starts[17] = {};
+    for (size_t lane = 0; lane < lanes; lane++) starts[(opcodes[lane] >> 12u) + 1]++;
+    for (unsigned int group = 1; group < 17; group++) starts[group] += starts[group - 1];
+    for (size_t lane = 0; lane < lanes; lane++) order[starts[opcodes[lane] >> 12u]++] = lane;
+
+    size_t begin = 0;
+    for (unsigned int group = 0; group < 16; group++) {
+        if (starts[group] != begin) executeGroup(group, &order[begin], starts[group] - begin);
+        begin = starts[group];
+    }
+}
+
+//Runs the lanes in list, whose opcodes all have top nibble group
+//The commonest groups get their own branch-free loops, the rest go through executeLane
+void LockstepChip8::executeGroup(unsigned int group, const uint32_t* list, size_t count) {
+    switch (group) {
+        case 0x1:
+            for (size_t i = 0; i < count; i++) program_counter[list[i]] = opcodes[list[i]] & 0x0FFFu;
+            return;
+        case 0x3:
+        case 0x4: {
+            bool equal_skips = group == 0x3;
+            for (size_t i = 0; i < count; i++) {
+                uint32_t lane = list[i];
+                uint16_t opcode = opcodes[lane];
+                uint8_t vx = registers[((opcode & 0x0F00u) >> 8u) * padded + lane];
+                program_counter[lane] += ((vx == (opcode & 0x00FFu)) == equal_skips) << 1u;
+            }
+            return;
+        }
+        case 0x6:
+            for (size_t i = 0; i < count; i++) {
+                uint32_t lane = list[i];
+                registers[((opcodes[lane] & 0x0F00u) >> 8u) * padded + lane] = opcodes[lane] & 0x00FFu;
+            }
+            return;
+        case 0x7:
+            for (size_t i = 0; i < count; i++) {
+                uint32_t lane = list[i];
+                registers[((opcodes[lane] & 0x0F00u) >> 8u) * padded + lane] += opcodes[lane] & 0x00FFu;
+            }
+            return;
+        case 0xA:
+            for (size_t i = 0; i < count; i++) memory_index[list[i]] = opcodes[list[i]] & 0x0FFFu;
+            return;
+        case 0xE:
+            //Decoded by the low nibble like Chip8: xE skips if pressed, x1 if not, others do nothing
+            for (size_t i = 0; i < count; i++) {
+                uint32_t lane = list[i];
+                uint16_t opcode = opcodes[lane];
+                uint8_t vx = registers[((opcode & 0x0F00u) >> 8u) * padded + lane];
+                bool pressed = keys[lane * KEY_COUNT + (vx & 0xFu)] != 0;
+                bool taken = (opcode & 0x000Fu) == 0xEu ? pressed : (opcode & 0x000Fu) == 0x1u && !pressed;
+                program_counter[lane] += taken << 1u;
+            }
+            return;
+        default:
+            for (size_t i = 0; i < count; i++) executeLane(list[i], opcodes[list[i]]);
+            return;
+    }
+}
+
+//Decrement delay and sound timers if set (saturating subtract)
+void LockstepChip8::tickTimers() {
+    V one = Vec::set1(1);
+    for (size_t i = 0; i < padded; i += Vec::width) {
+        Vec::store(&delay_timer[i], Vec::subs(Vec::load(&delay_timer[i]), one));
+        Vec::store(&sound_timer[i], Vec::subs(Vec::load(&sound_timer[i]), one));
+    }
+}
+
+//Runs opcode on every lane with vector kernels, padding lanes are masked off
+//Writes happen in the same order as the Chip8 handlers so Vx/Vy = VF aliasing matches
+//Returns false if the opcode has no vector kernel
+bool LockstepChip8::executeVector(uint16_t opcode) {
+    uint8_t x = (opcode & 0x0F00u) >> 8u;
+    uint8_t y = (opcode & 0x00F0u) >> 4u;
+    uint8_t kk = opcode & 0x00FFu;
+    uint8_t* vx = reg(x);
+    uint8_t* vy = reg(y);
+    uint8_t* vf = reg(0xF);
+    const uint8_t* m = active.data();
+
+    switch ((opcode & 0xF000u) >> 12u) {
+        case 0x1:
+            for (size_t lane = 0; lane < padded; lane++) {
+                program_counter[lane] = m[lane] ? opcode & 0x0FFFu : program_counter[lane];
+            }
+            return true;
+        case 0x3:
+        case 0x4:
+        case 0x5:
+        case 0x9: {
+            //Conditional skips: build taken mask in scratch, then advance program counters
+            bool equal_skips = (opcode & 0xF000u) == 0x3000u || (opcode & 0xF000u) == 0x5000u;
+            bool immediate = (opcode & 0xF000u) == 0x3000u || (opcode & 0xF000u) == 0x4000u;
+
+            for (size_t i = 0; i < padded; i += Vec::width) {
+                V rhs = immediate ? Vec::set1(kk) : Vec::load(vy + i);
+                V equal = Vec::eq(Vec::load(vx + i), rhs);
+                V taken = equal_skips ? equal : Vec::bitXor(equal, Vec::set1(0xFF));
+                Vec::store(&scratch[i], Vec::bitAnd(taken, Vec::load(m + i)));
+            }
+            for (size_t lane = 0; lane < padded; lane++) {
+                program_counter[lane] += scratch[lane] & 2u;
+            }
+            return true;
+        }
+        case 0x6:
+            for (size_t i = 0; i < padded; i += Vec::width) storeMasked(vx + i, m + i, Vec::set1(kk));
+            return true;
+        case 0x7:
+            for (size_t i = 0; i < padded; i += Vec::width) storeMasked(vx + i, m + i, Vec::add(Vec::load(vx + i), Vec::set1(kk)));
+            return true;
+        case 0xA:
+            for (size_t lane = 0; lane < padded; lane++) {
+                memory_index[lane] = m[lane] ? opcode & 0x0FFFu : memory_index[lane];
+            }
+            return true;
+        case 0xF:
+            switch (kk) {
+                case 0x07:
+                    for (size_t i = 0; i < padded; i += Vec::width) storeMasked(vx + i, m + i, Vec::load(&delay_timer[i]));
+                    return true;
+                case 0x15:
+                    for (size_t i = 0; i < padded; i += Vec::width) storeMasked(&delay_timer[i], m + i, Vec::load(vx + i));
+                    return true;
+                case 0x18:
+                    for (size_t i = 0; i < padded; i += Vec::width) storeMasked(&sound_timer[i], m + i, Vec::load(vx + i));
+                    return true;
+                case 0x1E:
+                    //Mask is 0 or 0xFF, so masked lanes add 0
+                    for (size_t lane = 0; lane < padded; lane++) memory_index[lane] += vx[lane] & m[lane];
+                    return true;
+                default:
+                    return false;
+            }
+        case 0x8:
+            break;
+        default:
+            return false;
+    }
+
+    V one = Vec::set1(1);
+    switch (opcode & 0x000Fu) {
+        case 0x0:
+            for (size_t i = 0; i < padded; i += Vec::width) storeMasked(vx + i, m + i, Vec::load(vy + i));
+            return true;
+        case 0x1:
+            for (size_t i = 0; i < padded; i += Vec::width) storeMasked(vx + i, m + i, Vec::bitOr(Vec::load(vx + i), Vec::load(vy + i)));
+            return true;
+        case 0x2:
+            for (size_t i = 0; i < padded; i += Vec::width) storeMasked(vx + i, m + i, Vec::bitAnd(Vec::load(vx + i), Vec::load(vy + i)));
+            return true;
+        case 0x3:
+            for (size_t i = 0; i < padded; i += Vec::width) storeMasked(vx + i, m + i, Vec::bitXor(Vec::load(vx + i), Vec::load(vy + i)));
+            return true;
+        case 0x4:
+            //Sum computed before VF is written, carry when the wrapped sum is below Vx
+            for (size_t i = 0; i < padded; i += Vec::width) {
+                V a = Vec::load(vx + i);
+                V sum = Vec::add(a, Vec::load(vy + i));
+                storeMasked(vf + i, m + i, Vec::bitAnd(Vec::gt(a, sum), one));
+                storeMasked(vx + i, m + i, sum);
+            }
+            return true;
+        case 0x5:
+            for (size_t i = 0; i < padded; i += Vec::width) {
+                storeMasked(vf + i, m + i, Vec::bitAnd(Vec::gt(Vec::load(vx + i), Vec::load(vy + i)), one));
+                storeMasked(vx + i, m + i, Vec::sub(Vec::load(vx + i), Vec::load(vy + i)));
+            }
+            return true;
+        case 0x7:
+            for (size_t i = 0; i < padded; i += Vec::width) {
+                storeMasked(vf + i, m + i, Vec::bitAnd(Vec::gt(Vec::load(vy + i), Vec::load(vx + i)), one));
+                storeMasked(vx + i, m + i, Vec::sub(Vec::load(vy + i), Vec::load(vx + i)));
+            }
+            return true;
+        default:
+            //Shifts need per-byte bit shifts, left to the scalar path
+            return false;
+    }
+}
+
+//Scalar execution of one lane, mirrors the Chip8 handlers
+void LockstepChip8::executeLane(size_t lane, uint16_t opcode) {
+    uint8_t x = (opcode & 0x0F00u) >> 8u;
+    uint8_t y = (opcode & 0x00F0u) >> 4u;
+    uint8_t kk = opcode & 0x00FFu;
+    uint16_t nnn = opcode & 0x0FFFu;
+    uint8_t n = opcode & 0x000Fu;
+
+    uint8_t& vx = registers[x * padded + lane];
+    uint8_t& vy = registers[y * padded + lane];
+    uint8_t& vf = registers[0xF * padded + lane];
+    uint16_t& pc = program_counter[lane];
+    uint16_t& index = memory_index[lane];
+    uint8_t& sp = stack_pointer[lane];
+    uint8_t* lane_memory = &memory[lane * MEM_SIZE];
+    uint16_t* lane_stack = &stack[lane * STACK_SIZE];
+    const uint8_t* lane_keys = &keys[lane * KEY_COUNT];
+
+    switch ((opcode & 0xF000u) >> 12u) {
+        case 0x0:
+            if (n == 0x0) memset(&video[lane * VIDEO_HEIGHT], 0, VIDEO_HEIGHT * sizeof(uint64_t));
+            else if (n == 0xE) pc = lane_stack[--sp & (STACK_SIZE - 1)];
+            break;
+        case 0x1: pc = nnn; break;
+        case 0x2:
+            lane_stack[sp++ & (STACK_SIZE - 1)] = pc;
+            pc = nnn;
+            break;
+        case 0x3: if (vx == kk) pc += 2; break;
+        case 0x4: if (vx != kk) pc += 2; break;
+        case 0x5: if (vx == vy) pc += 2; break;
+        case 0x6: vx = kk; break;
+        case 0x7: vx += kk; break;
+        case 0x8:
+            switch (n) {
+                case 0x0: vx = vy; break;
+                case 0x1: vx |= vy; break;
+                case 0x2: vx &= vy; break;
+                case 0x3: vx ^= vy; break;
+                case 0x4: {
+                    uint16_t sum = vx + vy;
+                    vf = sum > 255U;
+                    vx = sum & 0xFFu;
+                    break;
+                }
+                case 0x5:
+                    vf = vx > vy;
+                    vx -= vy;
+                    break;
+                case 0x6:
+                    vf = vx & 0x1u;
+                    vx >>= 1;
+                    break;
+                case 0x7:
+                    vf = vy > vx;
+                    vx = vy - vx;
+                    break;
+                case 0xE:
+                    vf = (vx & 0x80u) >> 7u;
+                    vx <<= 1;
+                    break;
+            }
+            break;
+        case 0x9: if (vx != vy) pc += 2; break;
+        case 0xA: index = nnn; break;
+        case 0xB: pc = registers[lane] + nnn; break;
+        case 0xC: vx = rngs[lane].nextByte() & kk; break;
+        case 0xD: drawLane(lane, x, y, n); break;
+        case 0xE:
+            if (n == 0xE && lane_keys[vx & 0xFu]) pc += 2;
+            else if (n == 0x1 && !lane_keys[vx & 0xFu]) pc += 2;
+            break;
+        case 0xF:
+            switch (kk) {
+                case 0x07: vx = delay_timer[lane]; break;
+                case 0x0A: {
+                    unsigned int key = 0;
+                    while (key < KEY_COUNT && !lane_keys[key]) key++;
+                    if (key < KEY_COUNT) vx = key;
+                    else pc -= 2;
+                    break;
+                }
+                case 0x15: delay_timer[lane] = vx; break;
+                case 0x18: sound_timer[lane] = vx; break;
+                case 0x1E: index += vx; break;
+                case 0x29: index = FONTSET_START_ADDRESS + (5 * vx); break;
+                case 0x33: {
+                    uint8_t val = vx;
+                    lane_memory[(index + 2) & (MEM_SIZE - 1)] = val % 10;
+                    val /= 10;
+                    lane_memory[(index + 1) & (MEM_SIZE - 1)] = val % 10;
+                    val /= 10;
+                    lane_memory[index & (MEM_SIZE - 1)] = val % 10;
+                    break;
+                }
+                case 0x55:
+                    for (uint8_t i = 0; i <= x; i++) lane_memory[(index + i) & (MEM_SIZE - 1)] = registers[i * padded + lane];
+                    break;
+                case 0x65:
+                    for (uint8_t i = 0; i <= x; i++) registers[i * padded + lane] = lane_memory[(index + i) & (MEM_SIZE - 1)];
+                    break;
+            }
+            break;
+    }
+}
+
+//Dxyn on the packed framebuffer, same edge handling as Chip8::op_dxyn
+void LockstepChip8::drawLane(size_t lane, uint8_t x, uint8_t y, uint8_t height) {
+    uint64_t* rows = &video[lane * VIDEO_HEIGHT];
+    const uint8_t* lane_memory = &memory[lane * MEM_SIZE];
+    uint8_t& vf = registers[0xF * padded + lane];
+
+    uint8_t xpos = registers[x * padded + lane] % VIDEO_WIDTH;
+    uint8_t ypos = registers[y * padded + lane] % VIDEO_HEIGHT;
+    vf = 0;
+
+    for (unsigned int row = 0; row < height; row++) {
+        unsigned int line = ypos + row;
+        if (line >= VIDEO_HEIGHT) {
+            if (draw_mode == DrawMode::Clip) break;
+            line -= VIDEO_HEIGHT;
+        }
+
+        uint8_t sprite = lane_memory[(memory_index[lane] + row) & (MEM_SIZE - 1)];
+        if (drawSpriteRow(rows[line], sprite, xpos, draw_mode)) vf = 1;
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "chip8.hpp"
+#include "rom.hpp"
+
+//Lockstep interpreter for many CHIP-8 machines at once
+//State is stored structure-of-arrays: each register, program counter, index and timer
+//is one contiguous array across lanes, so an instruction every lane fetched is applied
+//to all lanes at once with SIMD kernels. Once lanes fetch different opcodes, they run
+//sorted by opcode class.
+class LockstepChip8 {
+    public:
+        explicit LockstepChip8(size_t lanes);
+
+        //Loads the same program into every lane, false if it couldn't be loaded (see rom.hpp)
+        bool loadRom(const char* filename);
+        //False if the program doesn't fit in CHIP-8 memory
+        bool loadRom(const RomImage& image);
+        void seed(size_t lane, uint32_t value);
+
+        //Executes one instruction on every lane, same semantics as Chip8::cycle()
+        void cycle();
+        //60 Hz timer tick for every lane, same as Chip8::tickTimers()
+        void tickTimers();
+
+        size_t size() const;
+        uint8_t* keypad(size_t lane);
+
+        void setDrawMode(DrawMode mode);
+
+        //Expands lane framebuffer into RGBA pixels
+        void getVideo(size_t lane, uint32_t* pixels) const;
+        //Packed rows of lane framebuffer, same layout as Chip8::video
+        const uint64_t* getRows(size_t lane) const;
+        uint8_t getRegister(size_t lane, unsigned int index) const;
+        uint16_t getProgramCounter(size_t lane) const;
+        uint16_t getIndex(size_t lane) const;
+        //Lane state in the layout Chip8::saveState() writes for a CHIP-8 machine, for comparing lanes
+        //against Chip8 (difftest). Keys are copied too, memory past 4 KB and extended state are zero
+        void saveState(size_t lane, Snapshot& snapshot) const;
+
+    private:
+        size_t lanes;
+        //Lane count rounded up to the widest vector, padding lanes are never active
+        size_t padded;
+
+        //Per-register arrays across lanes: registers[reg * padded + lane]
+        std::vector<uint8_t> registers;
+        std::vector<uint16_t> program_counter;
+        std::vector<uint16_t> memory_index;
+        std::vector<uint8_t> stack_pointer;
+        std::vector<uint8_t> delay_timer;
+        std::vector<uint8_t> sound_timer;
+
+        //Per-lane blocks, addresses diverge between lanes
+        std::vector<uint8_t> memory;       //[lane][MEM_SIZE]
+        std::vector<uint16_t> stack;       //[lane][STACK_SIZE]
+        std::vector<uint64_t> video;       //[lane][VIDEO_HEIGHT], 1 bit per pixel, MSB is x = 0
+        std::vector<uint8_t> keys;         //[lane][KEY_COUNT]
+
+        DrawMode draw_mode{DrawMode::Clip};
+
+        std::vector<Rng> rngs;
+
+        //0xFF for real lanes, 0 for padding
+        std::vector<uint8_t> active;
+
+        //Scratch for each cycle
+        std::vector<uint16_t> opcodes;
+        std::vector<uint32_t> order;
+        std::vector<uint8_t> scratch;
+
+        uint8_t* reg(unsigned int index);
+
+        bool executeVector(uint16_t opcode);
+        void executeGroup(unsigned int group, const uint32_t* list, size_t count);
+        void executeLane(size_t lane, uint16_t opcode);
+        void drawLane(size_t lane, uint8_t x, uint8_t y, uint8_t height);
+};
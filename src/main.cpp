@@ -1,41 +1,356 @@
+#include "capture.hpp"
 #include "chip8.hpp"
+#include "movie.hpp"
 #include "platform.hpp"
+#include "rewind.hpp"
+#include "rom.hpp"
+#include "scheduler.hpp"
+#include "triple_buffer.hpp"
+#include <atomic>
+#include <cctype>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <thread>
+
+namespace {
+
+//Completed frame handed from the emulation thread to the render thread
+struct Frame {
+    uint64_t video[VIDEO_HEIGHT];
+    //128x64 bitplanes, used instead of video by SCHIP and XO-CHIP
+    uint64_t xvideo[PLANE_COUNT][HIRES_HEIGHT][2];
+    //Earliest key press applied before this frame that the render thread hasn't reported, 0 if none
+    uint64_t press;
+};
+
+}
 
 int main(int argc, char** argv) {
-    //Takes arguments for video scale, cycle delay, and ROM to load
-    if (argc != 4) {
-        std::cerr << "Invalid arguments. Correct usage is " << argv[0] << " <scale> <delay> <ROM>\n";
+    //Takes arguments for video scale, instructions per 60 Hz frame, and ROM to load
+    //Optional flags:
+    //  --schip        run as SUPER-CHIP (128x64 display, scrolling, big font)
+    //  --xochip       run as XO-CHIP (SCHIP plus 64 KB memory and two bitplanes)
+    //  --quirks <q>   interpreter behaviors, e.g. vip or schip,wrap (see parseQuirks), instead of <ROM>.quirks
+    //  --vip          COSMAC VIP timing: frames spend VIP machine cycles instead of <instructions per frame>,
+    //                 and Dxyn waits for the next frame. Always interpreted, can't be recorded
+    //  --jit          use the block recompiler instead of the interpreter
+    //  --aot          run the ROM's ahead-of-time recompiled blocks if it was built in (make AOT_ROMS=...)
+    //  --turbo <n>    fast-forward without frame pacing, presenting every nth frame
+    //  --rewind <s>   seconds of rewind history kept (hold Backspace), 0 disables
+    //  --profile [n]  print opcode counters on exit, and every n frames if given (needs PROFILE=1 build)
+    //  --latency      print key-to-test and key-to-present latency on exit
+    //  --timing       print emulation frame time and wake-up jitter, render present time and interval, and
+    //                 emulated versus host time on exit
+    //  --seed <n>     seed Cxkk's RNG instead of using the clock
+    //  --record <f>   record an input movie for headless replay with batch --movie (disables rewind)
+    //  --capture <f>  write every changed frame to f (.y4m video, otherwise delta format)
+    if (argc < 4) {
+        std::cerr << "Invalid arguments. Correct usage is " << argv[0] << " <scale> <instructions per frame> <ROM> [--schip | --xochip] [--quirks <list>] [--vip] [--jit | --aot] [--turbo <n>] [--rewind <s>] [--profile [n]] [--latency] [--timing] [--seed <n>] [--record <file>] [--capture <file>]\n";
         std::exit(EXIT_FAILURE);
     }
 
     int video_scale = std::stoi(argv[1]);
-    int cycle_delay = std::stoi(argv[2]);
+    int instructions_per_frame = std::stoi(argv[2]);
     const char* rom_filename = argv[3];
 
-    Platform platform("CHIP-8 Emulator", VIDEO_WIDTH * video_scale, VIDEO_HEIGHT * video_scale, VIDEO_WIDTH, VIDEO_HEIGHT);
+    Machine machine = Machine::Chip8;
+    bool use_jit = false;
+    bool use_aot = false;
+    int turbo_skip = 0;
+    int rewind_seconds = 30;
+    bool profile = false;
+    unsigned int profile_interval = 0;
+    bool latency = false;
+    bool timing = false;
+    bool seeded = false;
+    uint32_t seed = 0;
+    const char* record_filename = nullptr;
+    const char* capture_filename = nullptr;
+    const char* quirks_spec = nullptr;
+    bool vip = false;
+    for (int i = 4; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--schip") machine = Machine::SuperChip;
+        else if (arg == "--xochip") machine = Machine::XoChip;
+        else if (arg == "--quirks" && i + 1 < argc) quirks_spec = argv[++i];
+        else if (arg == "--vip") vip = true;
+        else if (arg == "--jit") use_jit = true;
+        else if (arg == "--aot") use_aot = true;
+        else if (arg == "--turbo" && i + 1 < argc) turbo_skip = std::stoi(argv[++i]);
+        else if (arg == "--rewind" && i + 1 < argc) rewind_seconds = std::stoi(argv[++i]);
+        else if (arg == "--profile") {
+            profile = true;
+            if (i + 1 < argc && isdigit(static_cast<unsigned char>(argv[i + 1][0]))) profile_interval = std::stoul(argv[++i]);
+        }
+        else if (arg == "--latency") latency = true;
+        else if (arg == "--timing") timing = true;
+        else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::stoul(argv[++i]);
+            seeded = true;
+        }
+        else if (arg == "--record" && i + 1 < argc) record_filename = argv[++i];
+        else if (arg == "--capture" && i + 1 < argc) capture_filename = argv[++i];
+        else {
+            std::cerr << "Unknown argument " << arg << "\n";
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    //Movies replay a fixed instruction count per frame
+    if (vip && record_filename) {
+        std::cerr << "--record can't be combined with --vip\n";
+        std::exit(EXIT_FAILURE);
+    }
+    if (vip && (use_jit || use_aot)) {
+        std::cerr << "--vip times every instruction on the interpreter, --jit and --aot ignored\n";
+        use_jit = use_aot = false;
+    }
+
+#ifndef CHIP8_PROFILE
+    if (profile) std::cerr << "Built without CHIP8_PROFILE, --profile ignored (rebuild with make PROFILE=1)\n";
+    (void)profile_interval;
+#else
+    uint64_t profile_printed = 0;
+#endif
+
+    RomError error;
+    std::shared_ptr<const RomImage> image = RomCache::global().load(rom_filename, &error);
+    if (!image) {
+        std::cerr << "Could not load " << rom_filename << ": " << romErrorString(error) << "\n";
+        std::exit(EXIT_FAILURE);
+    }
 
     Chip8 chip8;
-    chip8.loadRom(rom_filename);
+    chip8.setMachine(machine);
+    if (!chip8.loadRom(*image)) {
+        std::cerr << "Could not load " << rom_filename << ": programs over " << MEM_SIZE - START_ADDRESS << " bytes need --xochip\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    Quirks quirks = Quirks::defaults(machine);
+    if (quirks_spec ? !parseQuirks(quirks_spec, quirks) : !loadQuirksFile(rom_filename, quirks)) {
+        std::cerr << "Invalid quirks " << (quirks_spec ? quirks_spec : "file") << ", expected a list of vip, schip, xochip, shift-vy, load-store-increment, jump-vx, wrap, vf-reset\n";
+        std::exit(EXIT_FAILURE);
+    }
+    chip8.setQuirks(quirks);
+
+    if (use_jit) chip8.setEngine(Engine::Jit);
+    if (use_aot) {
+        chip8.setEngine(Engine::Aot);
+        if (chip8.getEngine() != Engine::Aot) std::cerr << "No recompiled program for " << rom_filename << ", using the interpreter\n";
+    }
+
+    //The window keeps its size, extended machines render into a 128x64 texture
+    bool extended = machine != Machine::Chip8;
+    unsigned int display_width = chip8.displayWidth();
+    Platform platform("CHIP-8 Emulator", VIDEO_WIDTH * video_scale, VIDEO_HEIGHT * video_scale, display_width, chip8.displayHeight());
+
+    Scheduler scheduler(chip8, instructions_per_frame);
+    if (turbo_skip > 0) scheduler.setTurbo(true, turbo_skip);
+    if (vip) {
+        scheduler.setCycleBudget(VIP_CYCLES_PER_FRAME);
+        chip8.setDisplayWait(true);
+    }
+
+    //A movie is only replayable from a known seed, and rewinding would fork its history
+    MovieWriter recorder;
+    if (record_filename) {
+        if (!seeded) seed = static_cast<uint32_t>(std::chrono::system_clock::now().time_since_epoch().count());
+        seeded = true;
+        if (!recorder.open(record_filename, {image->hash, seed, static_cast<uint32_t>(instructions_per_frame), static_cast<uint32_t>(machine), quirks.bits()})) {
+            std::cerr << "Could not write movie " << record_filename << "\n";
+            std::exit(EXIT_FAILURE);
+        }
+        scheduler.setRecorder(&recorder);
+        rewind_seconds = 0;
+    }
+    if (seeded) chip8.seed(seed);
+
+    FrameCapture capture;
+    if (capture_filename && extended) {
+        std::cerr << "--capture only records the 64x32 CHIP-8 display\n";
+        std::exit(EXIT_FAILURE);
+    }
+    if (capture_filename && !capture.open(capture_filename)) {
+        std::cerr << "Could not write capture " << capture_filename << "\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    //One snapshot per frame for the last rewind_seconds
+    RewindBuffer rewind(rewind_seconds > 0 ? rewind_seconds * Scheduler::FRAME_RATE : 0);
+    Snapshot snapshot{};
+
+    //Emulation runs on its own thread and this one, which owns SDL, is the render thread
+    //It reads input into the ring and presents the newest frame from the triple buffer,
+    //so a stall in the display driver never holds up instruction execution
+    InputRing input;
+    scheduler.setInput(&input);
+    TripleBuffer<Frame> frames;
+    std::atomic<bool> quit{false};
+    std::atomic<bool> rewinding{false};
+    //Newest press the render thread has reported, so presses aren't lost with skipped frames
+    std::atomic<uint64_t> press_reported{0};
+
+    std::thread emulation([&] {
+        uint64_t press = 0;
+
+        while (!quit.load(std::memory_order_relaxed)) {
+            //While rewinding, frames step back through history instead of running
+            bool render;
+            if (rewinding.load(std::memory_order_relaxed) && rewind_seconds > 0) {
+                scheduler.applyPendingInput();
+                if (rewind.pop(snapshot)) {
+                    //Keys held now stay held, the snapshot's keypad is from the frame being restored
+                    memcpy(snapshot.keypad, chip8.keypad, sizeof(snapshot.keypad));
+                    chip8.loadState(snapshot);
+                }
+                render = true;
+            }
+            else {
+                render = scheduler.runFrame();
+                capture.submit(chip8.video, scheduler.frameCount());
+                if (rewind_seconds > 0) {
+                    chip8.saveState(snapshot);
+                    rewind.push(snapshot);
+                }
+            }
 
-    int video_pitch = sizeof(chip8.video[0]) * VIDEO_WIDTH;
-    auto last_cycletime = std::chrono::high_resolution_clock::now();
+            uint64_t applied = scheduler.takeAppliedPress();
+            if (applied && (!press || applied < press)) press = applied;
+            if (press && press <= press_reported.load(std::memory_order_relaxed)) press = 0;
 
-    bool quit = false;
-    while (!quit) {
-        quit = platform.processInput(chip8.keypad);
+            //Turbo frames that aren't rendered and frames that didn't draw are never published
+            //The render thread diffs against what it shows, so skipped frames lose nothing
+            if (render && (chip8.takeDirtyRows() || press)) {
+                Frame& frame = frames.back();
+                if (extended) memcpy(frame.xvideo, chip8.xvideo, sizeof(frame.xvideo));
+                else memcpy(frame.video, chip8.video, sizeof(frame.video));
+                frame.press = press;
+                frames.publish();
+            }
 
-        auto current_time = std::chrono::high_resolution_clock::now();
-        
-        //Getting difference between last cycle time and current time (length of time since last cycle)
-		float dt = std::chrono::duration<float, std::chrono::milliseconds::period>(current_time - last_cycletime).count();
+#ifdef CHIP8_PROFILE
+            if (profile && profile_interval && scheduler.frameCount() >= profile_printed + profile_interval) {
+                chip8.printProfile(stderr);
+                profile_printed = scheduler.frameCount();
+            }
+#endif
 
-        //If time since last cycle is greater than the cycle delay, run cycle and update video
-        if (dt > cycle_delay) {
-            last_cycletime = current_time;
-            chip8.cycle();
-            platform.update(chip8.video, video_pitch);
+            scheduler.waitForNextFrame();
+        }
+    });
+
+    //Packed copy of what is on screen, diffed against each new frame to find changed rows
+    //On the 128x64 display dirty bit y covers rows 2y and 2y + 1, as in Chip8::takeDirtyRows()
+    uint64_t shown[VIDEO_HEIGHT]{};
+    uint64_t shown_wide[PLANE_COUNT][HIRES_HEIGHT][2]{};
+    uint32_t pixels[HIRES_WIDTH * HIRES_HEIGHT]{};
+    int video_pitch = sizeof(pixels[0]) * display_width;
+    //Indexed by (plane 1 bit << 1) | plane 0 bit
+    const uint32_t palette[4] = {0x00000000u, 0xFFFFFFFFu, 0xAAAAAAFFu, 0x555555FFu};
+    platform.update(pixels, video_pitch);
+
+    //Unchanged frames are only re-presented this often, to keep the window refreshed
+    const std::chrono::seconds present_interval(1);
+    auto last_present = std::chrono::steady_clock::now();
+
+    //Presses older than this when their frame changes are treated as unrelated to it
+    const uint64_t max_present_latency = 1000000000;
+    LatencyStats present_latency;
+    LatencyStats present_time;
+    LatencyStats present_gap;
+
+    while (!quit.load(std::memory_order_relaxed)) {
+        //Waits briefly for input so key timestamps stay close to when they arrived
+        if (platform.processInput(input, 1)) quit.store(true);
+        rewinding.store(platform.rewindHeld(), std::memory_order_relaxed);
+
+        uint32_t dirty = 0;
+        uint64_t press = 0;
+        if (frames.update()) {
+            const Frame& frame = frames.front();
+            if (extended) {
+                for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+                    for (unsigned int row = 0; row < HIRES_HEIGHT; row++) {
+                        if (memcmp(frame.xvideo[plane][row], shown_wide[plane][row], sizeof(shown_wide[plane][row])) != 0) dirty |= 1u << (row / 2);
+                    }
+                }
+                memcpy(shown_wide, frame.xvideo, sizeof(shown_wide));
+            }
+            else {
+                for (unsigned int row = 0; row < VIDEO_HEIGHT; row++) {
+                    if (frame.video[row] != shown[row]) dirty |= 1u << row;
+                }
+                memcpy(shown, frame.video, sizeof(shown));
+            }
+            press = frame.press;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (dirty) {
+            //Upload band of rows changed since last presented frame
+            int first_row = 0;
+            while (!(dirty & (1u << first_row))) first_row++;
+            int last_row = VIDEO_HEIGHT - 1;
+            while (!(dirty & (1u << last_row))) last_row--;
+
+            if (extended) {
+                expandWideRows(shown_wide, 2 * first_row, 2 * (last_row - first_row + 1), pixels, palette);
+                platform.update(pixels, video_pitch, 2 * first_row, 2 * (last_row - first_row + 1));
+            }
+            else {
+                expandRows(shown, first_row, last_row - first_row + 1, pixels, VIDEO_WIDTH);
+                platform.update(pixels, video_pitch, first_row, last_row - first_row + 1);
+            }
+        }
+        else if (now - last_present >= present_interval) {
+            platform.present();
+        }
+        else {
+            continue;
+        }
+
+        auto presented = std::chrono::steady_clock::now();
+        present_time.record(std::chrono::duration_cast<std::chrono::nanoseconds>(presented - now).count());
+        present_gap.record(std::chrono::duration_cast<std::chrono::nanoseconds>(presented - last_present).count());
+        last_present = presented;
+
+        if (dirty && press > press_reported.load(std::memory_order_relaxed)) {
+            uint64_t shown_at = inputTimestamp();
+            if (shown_at - press < max_present_latency) present_latency.record(shown_at - press);
+            press_reported.store(press, std::memory_order_relaxed);
         }
     }
+    emulation.join();
+    capture.close();
+
+    if (record_filename) recorder.finish(scheduler.instructionCount(), chip8.hashDisplay());
+
+    if (latency) {
+        scheduler.keyLatency().print(stderr, "key to test (Ex9E/ExA1/Fx0A)");
+        present_latency.print(stderr, "key to present");
+        if (input.dropped()) fprintf(stderr, "%llu input events dropped\n", static_cast<unsigned long long>(input.dropped()));
+    }
+
+    if (timing) {
+        scheduler.frameTime().print(stderr, "emulation time per frame");
+        scheduler.wakeLateness().print(stderr, "emulation wake-up lateness");
+        present_time.print(stderr, "render upload + present");
+        present_gap.print(stderr, "render interval between presents");
+
+        //Emulated time is frames at 60 Hz, host time only counts running them
+        const LatencyStats& frame_time = scheduler.frameTime();
+        double emulated = static_cast<double>(scheduler.frameCount()) / Scheduler::FRAME_RATE;
+        double host = frame_time.count() * frame_time.meanMicroseconds() / 1e6;
+        fprintf(stderr, "%.1f s emulated in %.3f s of host time (%.0fx real time), %llu instructions",
+            emulated, host, host > 0 ? emulated / host : 0.0, static_cast<unsigned long long>(scheduler.instructionCount()));
+        if (vip) fprintf(stderr, ", %llu VIP cycles", static_cast<unsigned long long>(scheduler.cycleCount()));
+        fprintf(stderr, "\n");
+    }
+
+#ifdef CHIP8_PROFILE
+    if (profile) chip8.printProfile(stderr);
+#endif
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,153 @@
+#include "movie.hpp"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+const char movie_magic[4] = {'C', '8', 'M', 'V'};
+const uint32_t movie_version = 3;
+const uint8_t end_record = 0xFF;
+
+void writeLittle(FILE* file, uint64_t value, unsigned int bytes) {
+    for (unsigned int i = 0; i < bytes; i++) fputc(static_cast<int>((value >> (8 * i)) & 0xFFu), file);
+}
+
+bool readLittle(const std::vector<uint8_t>& data, size_t& position, unsigned int bytes, uint64_t& value) {
+    if (data.size() - position < bytes) return false;
+
+    value = 0;
+    for (unsigned int i = 0; i < bytes; i++) value |= static_cast<uint64_t>(data[position++]) << (8 * i);
+    return true;
+}
+
+bool readVarint(const std::vector<uint8_t>& data, size_t& position, uint64_t& value) {
+    value = 0;
+    for (unsigned int shift = 0; shift < 64 && position < data.size(); shift += 7) {
+        uint8_t byte = data[position++];
+        value |= static_cast<uint64_t>(byte & 0x7Fu) << shift;
+        if (!(byte & 0x80u)) return true;
+    }
+    return false;
+}
+
+}
+
+MovieWriter::~MovieWriter() {
+    if (file) fclose(file);
+}
+
+bool MovieWriter::open(const char* filename, const MovieHeader& header) {
+    if (file) fclose(file);
+
+    file = fopen(filename, "wb");
+    if (!file) return false;
+
+    fwrite(movie_magic, 1, sizeof(movie_magic), file);
+    writeLittle(file, movie_version, 4);
+    writeLittle(file, header.rom_hash, 8);
+    writeLittle(file, header.seed, 4);
+    writeLittle(file, header.instructions_per_frame, 4);
+    writeLittle(file, header.machine, 4);
+    writeLittle(file, header.quirks, 4);
+    last_cycle = 0;
+    unflushed = true;
+    return true;
+}
+
+bool MovieWriter::isOpen() const {
+    return file != nullptr;
+}
+
+void MovieWriter::writeVarint(uint64_t value) {
+    while (value >= 0x80u) {
+        fputc(static_cast<int>((value & 0x7Fu) | 0x80u), file);
+        value >>= 7;
+    }
+    fputc(static_cast<int>(value), file);
+}
+
+void MovieWriter::keyEvent(uint64_t cycle, uint8_t key, uint8_t pressed) {
+    if (!file) return;
+
+    writeVarint(cycle - last_cycle);
+    fputc((key & 0xFu) | (pressed ? 0x10u : 0u), file);
+    last_cycle = cycle;
+    unflushed = true;
+}
+
+void MovieWriter::flush() {
+    if (!file || !unflushed) return;
+
+    fflush(file);
+    unflushed = false;
+}
+
+void MovieWriter::finish(uint64_t cycles, uint64_t video_hash) {
+    if (!file) return;
+
+    writeVarint(cycles - last_cycle);
+    fputc(end_record, file);
+    writeLittle(file, video_hash, 8);
+    fclose(file);
+    file = nullptr;
+}
+
+bool MovieReader::open(const char* filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) return false;
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    size_t position = 0;
+    uint64_t version, rom_hash, seed, instructions_per_frame, machine = 0, quirks = MovieHeader::QUIRKS_UNKNOWN;
+    if (data.size() < sizeof(movie_magic) || memcmp(data.data(), movie_magic, sizeof(movie_magic)) != 0) return false;
+    position += sizeof(movie_magic);
+    if (!readLittle(data, position, 4, version) || version < 1 || version > movie_version) return false;
+    if (!readLittle(data, position, 8, rom_hash) || !readLittle(data, position, 4, seed)
+        || !readLittle(data, position, 4, instructions_per_frame)) return false;
+    if (version >= 2 && !readLittle(data, position, 4, machine)) return false;
+    if (version >= 3 && !readLittle(data, position, 4, quirks)) return false;
+
+    movie_header = {rom_hash, static_cast<uint32_t>(seed), static_cast<uint32_t>(instructions_per_frame), static_cast<uint32_t>(machine),
+        static_cast<uint32_t>(quirks)};
+    movie_events.clear();
+    has_end = false;
+
+    //A truncated trailing record is dropped
+    uint64_t cycle = 0;
+    uint64_t delta;
+    while (position < data.size() && readVarint(data, position, delta) && position < data.size()) {
+        cycle += delta;
+        uint8_t record = data[position++];
+
+        if (record == end_record) {
+            if (!readLittle(data, position, 8, end_hash)) break;
+            end_cycle = cycle;
+            has_end = true;
+            break;
+        }
+        movie_events.push_back({cycle, static_cast<uint8_t>(record & 0xFu), static_cast<uint8_t>((record >> 4) & 1u)});
+    }
+    return true;
+}
+
+const MovieHeader& MovieReader::header() const {
+    return movie_header;
+}
+
+const std::vector<MovieEvent>& MovieReader::events() const {
+    return movie_events;
+}
+
+bool MovieReader::complete() const {
+    return has_end;
+}
+
+uint64_t MovieReader::cycles() const {
+    if (has_end) return end_cycle;
+    return movie_events.empty() ? 0 : movie_events.back().cycle;
+}
+
+uint64_t MovieReader::videoHash() const {
+    return end_hash;
+}
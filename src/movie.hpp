@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+//Input movie: key transitions stamped with the instruction count they were applied at
+//Replaying the events at the same instruction counts with the same seed and instructions
+//per frame reproduces a session exactly, independent of host speed
+//
+//File layout, little-endian:
+//  "C8MV", u32 version, u64 ROM hash (hashRom), u32 seed, u32 instructions per frame,
+//  u32 machine (version 2 on, a Machine value; version 1 movies are CHIP-8)
+//  u32 quirks (version 3 on, Quirks::bits(); earlier movies don't say)
+//  records: varint cycle delta from the previous record, then one byte
+//           0x00-0x1F: key in the low nibble, bit 4 set for press
+//           0xFF:      end of movie, followed by u64 hash of the final display (hashDisplay)
+//A movie cut short (crash, kill) has no end record but every event written so far is valid
+
+struct MovieHeader {
+    //quirks of movies recorded before version 3
+    static const uint32_t QUIRKS_UNKNOWN = 0xFFFFFFFFu;
+
+    uint64_t rom_hash;
+    uint32_t seed;
+    uint32_t instructions_per_frame;
+    uint32_t machine;
+    uint32_t quirks;
+};
+
+struct MovieEvent {
+    uint64_t cycle;
+    uint8_t key;
+    uint8_t pressed;
+};
+
+//Streams events to disk as they are recorded
+class MovieWriter {
+    public:
+        MovieWriter() = default;
+        ~MovieWriter();
+
+        MovieWriter(const MovieWriter&) = delete;
+        MovieWriter& operator=(const MovieWriter&) = delete;
+
+        bool open(const char* filename, const MovieHeader& header);
+        bool isOpen() const;
+
+        //Events must be recorded in cycle order
+        void keyEvent(uint64_t cycle, uint8_t key, uint8_t pressed);
+        //Pushes buffered events to the file, cheap when nothing was recorded
+        void flush();
+        //Writes the end record and closes the file
+        void finish(uint64_t cycles, uint64_t video_hash);
+
+    private:
+        FILE* file{};
+        uint64_t last_cycle{};
+        bool unflushed{};
+
+        void writeVarint(uint64_t value);
+};
+
+class MovieReader {
+    public:
+        //Returns false if the file can't be read or isn't a movie of a known version
+        bool open(const char* filename);
+
+        const MovieHeader& header() const;
+        const std::vector<MovieEvent>& events() const;
+
+        //True if the movie has its end record, which gives cycles() and videoHash()
+        bool complete() const;
+        //Instructions executed in the recorded session, or the last event's cycle if incomplete
+        uint64_t cycles() const;
+        uint64_t videoHash() const;
+
+    private:
+        MovieHeader movie_header{};
+        std::vector<MovieEvent> movie_events;
+        bool has_end{};
+        uint64_t end_cycle{};
+        uint64_t end_hash{};
+};
@@ -1,6 +1,8 @@
 #include "platform.hpp"
 
-Platform::Platform(const char* title, int window_width, int window_height, int texture_width, int texture_height) {
+Platform::Platform(const char* title, int window_width, int window_height, int texture_width, int texture_height)
+    :texture_width(texture_width) {
+
     SDL_Init(SDL_INIT_VIDEO);
     window = SDL_CreateWindow(title, 0, 0, window_width, window_height, SDL_WINDOW_SHOWN);
     renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
@@ -19,14 +21,29 @@ Platform::~Platform() {
 //Updates rendered visuals
 void Platform::update(const void* pixels, int pitch) {
     SDL_UpdateTexture(texture, nullptr, pixels, pitch);
+    present();
+}
+
+//Updates rendered visuals for a band of rows
+//pixels points at the full frame, only the changed rows are copied to the texture
+void Platform::update(const void* pixels, int pitch, int first_row, int row_count) {
+    SDL_Rect rows{0, first_row, texture_width, row_count};
+    SDL_UpdateTexture(texture, &rows, static_cast<const uint8_t*>(pixels) + first_row * pitch, pitch);
+    present();
+}
+
+void Platform::present() {
     SDL_RenderClear(renderer);
     SDL_RenderCopy(renderer, texture, nullptr, nullptr);
     SDL_RenderPresent(renderer);
 }
 
-//Processes keypad inputs
-//Returns true for quitting and false for continuing
-/*      Keypad mapping:
+bool Platform::rewindHeld() const {
+    return rewind_held;
+}
+
+//Keypad mapping:
+/*
     Keypad       Keyboard
     +-+-+-+-+    +-+-+-+-+
     |1|2|3|C|    |1|2|3|4|
@@ -37,130 +54,58 @@ void Platform::update(const void* pixels, int pitch) {
     +-+-+-+-+    +-+-+-+-+
     |A|0|B|F|    |Z|X|C|V|
     +-+-+-+-+    +-+-+-+-+
+    Backspace is held to rewind
 */
-bool Platform::processInput(uint8_t* keys) {
+//Returns the keypad index for a keyboard key, or -1 if it isn't mapped
+static int keypadKey(SDL_Keycode key) {
+    switch (key) {
+        case SDLK_x: return 0x0;
+        case SDLK_1: return 0x1;
+        case SDLK_2: return 0x2;
+        case SDLK_3: return 0x3;
+        case SDLK_q: return 0x4;
+        case SDLK_w: return 0x5;
+        case SDLK_e: return 0x6;
+        case SDLK_a: return 0x7;
+        case SDLK_s: return 0x8;
+        case SDLK_d: return 0x9;
+        case SDLK_z: return 0xA;
+        case SDLK_c: return 0xB;
+        case SDLK_4: return 0xC;
+        case SDLK_r: return 0xD;
+        case SDLK_f: return 0xE;
+        case SDLK_v: return 0xF;
+    }
+    return -1;
+}
+
+//Processes keypad inputs, waiting up to timeout_ms for the first event
+//Key transitions are timestamped and queued for the emulation thread
+//Returns true for quitting and false for continuing
+bool Platform::processInput(InputRing& input, int timeout_ms) {
     SDL_Event event;
+    if (!SDL_WaitEventTimeout(&event, timeout_ms)) return false;
 
-    while (SDL_PollEvent(&event)) {
+    do {
         switch(event.type) {
-            case SDL_QUIT: 
-            //If event is quit return true for quitting
+            case SDL_QUIT:
+                //If event is quit return true for quitting
                 return true;
-                break; 
-            case SDL_KEYDOWN: { 
-                //For keypress event, set corresponding array key
-                switch (event.key.keysym.sym) {
-                    case SDLK_ESCAPE:
-                        return true;
-                        break;
-                    case SDLK_x:
-                        keys[0] = 1;
-                        break;
-                    case SDLK_1:
-                        keys[1] = 1;
-                        break;
-                    case SDLK_2:
-                        keys[2] = 1;
-                        break;
-                    case SDLK_3:
-                        keys[3] = 1;
-                        break;
-                    case SDLK_q:
-                        keys[4] = 1;
-                        break;
-                    case SDLK_w:
-                        keys[5] = 1;
-                        break;
-                    case SDLK_e:
-                        keys[6] = 1;
-                        break;
-                    case SDLK_a:
-                        keys[7] = 1;
-                        break;
-                    case SDLK_s:
-                        keys[8] = 1;
-                        break;
-                    case SDLK_d:
-                        keys[9] = 1;
-                        break;
-                    case SDLK_z:
-                        keys[0xA] = 1;
-                        break;
-                    case SDLK_c:
-                        keys[0xB] = 1;
-                        break;
-                    case SDLK_4:
-                        keys[0xC] = 1;
-                        break;
-                    case SDLK_r:
-                        keys[0xD] = 1;
-                        break;
-                    case SDLK_f:
-                        keys[0xE] = 1;
-                        break;
-                    case SDLK_v:
-                        keys[0xF] = 1;
-                        break;
-
-                }
-            }
-            break;
+            case SDL_KEYDOWN:
             case SDL_KEYUP: {
-                //For key release event, unset corresponding key array
-                switch (event.key.keysym.sym) {
-                    case SDLK_x:
-                        keys[0] = 0;
-                        break;
-                    case SDLK_1:
-                        keys[1] = 0;
-                        break;
-                    case SDLK_2:
-                        keys[2] = 0;
-                        break;
-                    case SDLK_3:
-                        keys[3] = 0;
-                        break;
-                    case SDLK_q:
-                        keys[4] = 0;
-                        break;
-                    case SDLK_w:
-                        keys[5] = 0;
-                        break;
-                    case SDLK_e:
-                        keys[6] = 0;
-                        break;
-                    case SDLK_a:
-                        keys[7] = 0;
-                        break;
-                    case SDLK_s:
-                        keys[8] = 0;
-                        break;
-                    case SDLK_d:
-                        keys[9] = 0;
-                        break;
-                    case SDLK_z:
-                        keys[0xA] = 0;
-                        break;
-                    case SDLK_c:
-                        keys[0xB] = 0;
-                        break;
-                    case SDLK_4:
-                        keys[0xC] = 0;
-                        break;
-                    case SDLK_r:
-                        keys[0xD] = 0;
-                        break;
-                    case SDLK_f:
-                        keys[0xE] = 0;
-                        break;
-                    case SDLK_v:
-                        keys[0xF] = 0;
-                        break;
+                bool pressed = event.type == SDL_KEYDOWN;
+                if (pressed && event.key.keysym.sym == SDLK_ESCAPE) return true;
+                if (event.key.keysym.sym == SDLK_BACKSPACE) rewind_held = pressed;
 
+                //Auto-repeat doesn't change keypad state
+                int key = keypadKey(event.key.keysym.sym);
+                if (key >= 0 && !event.key.repeat) {
+                    input.push({inputTimestamp(), static_cast<uint8_t>(key), static_cast<uint8_t>(pressed)});
                 }
+                break;
             }
-            break;
         }
-    }
+    } while (SDL_PollEvent(&event));
+
     return false;
-}
\ No newline at end of file
+}
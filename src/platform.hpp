@@ -2,16 +2,25 @@
 
 #include <cstdint>
 #include <SDL2/SDL.h>
+#include "input.hpp"
 
 class Platform {
     public:
         Platform(const char* title, int window_width, int window_height, int texture_width, int texture_height);
         ~Platform();
         void update(const void* pixels, int pitch);
-        bool processInput(uint8_t* keys);
+        //Uploads only texture rows [first_row, first_row + row_count), then presents
+        void update(const void* pixels, int pitch, int first_row, int row_count);
+        //Presents last uploaded texture again without uploading
+        void present();
+        bool processInput(InputRing& input, int timeout_ms = 0);
+        //True while the rewind key (Backspace) is held
+        bool rewindHeld() const;
 
     private:
         SDL_Window* window{};
         SDL_Renderer* renderer{};
         SDL_Texture* texture{};
+        int texture_width{};
+        bool rewind_held{};
 };
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "chip8.hpp"
+
+#ifdef CHIP8_PROFILE
+
+#include <algorithm>
+#include <vector>
+
+//Indexed by Chip8::Handler, the first character is the family nibble
+static const char* const handler_names[] = {
+    "decode",
+    "00E0", "00EE", "1nnn", "2nnn", "3xkk", "4xkk", "5xy0", "6xkk",
+    "7xkk", "8xy0", "8xy1", "8xy2", "8xy3", "8xy4", "8xy5", "8xy6",
+    "8xy7", "8xyE", "9xy0", "Annn", "Bnnn", "Cxkk", "Dxyn", "Ex9E",
+    "ExA1", "Fx07", "Fx0A", "Fx15", "Fx18", "Fx1E", "Fx29", "Fx33",
+    "Fx55", "Fx65",
+    "00Cn", "00Dn", "00FB", "00FC", "00FD", "00FE", "00FF", "5xy2",
+    "5xy3", "DxynX", "F000", "Fn01", "F002", "Fx30", "Fx3A", "Fx75",
+    "Fx85",
+    "8xy1v", "8xy2v", "8xy3v", "8xy6y", "8xyEy", "Bxnn", "Fx55i", "Fx65i",
+    "DxynW", "DxynXW",
+    "Annn+D", "6xkk*n", "Fx07+3", "7xkk+3",
+    "null",
+};
+
+const Profile& Chip8::getProfile() const {
+    return profile;
+}
+
+void Chip8::printProfile(FILE* out, unsigned int top_addresses) const {
+    static_assert(sizeof(handler_names) / sizeof(handler_names[0]) == HANDLER_COUNT, "handler_names out of sync with Chip8::Handler");
+
+    const double total = profile.instructions ? static_cast<double>(profile.instructions) : 1.0;
+
+    //Profile builds run everything through cycle(), see Chip8::run()
+    fprintf(out, "counted one instruction at a time through cycle(): no fused sequences, idle skipping or JIT\n");
+    fprintf(out, "instructions %llu, frames %llu", static_cast<unsigned long long>(profile.instructions),
+        static_cast<unsigned long long>(profile.frames));
+    if (profile.frames) {
+        fprintf(out, ", per frame min %llu avg %.1f max %llu", static_cast<unsigned long long>(profile.frame_min),
+            static_cast<double>(profile.frame_start) / profile.frames, static_cast<unsigned long long>(profile.frame_max));
+    }
+    fprintf(out, "\n");
+
+    if (profile.run_ns) {
+        fprintf(out, "run time %.3f ms: draw %.3f ms (%.1f%%), other %.3f ms\n", profile.run_ns / 1e6, profile.draw_ns / 1e6,
+            100.0 * profile.draw_ns / profile.run_ns, (profile.run_ns - std::min(profile.draw_ns, profile.run_ns)) / 1e6);
+    }
+
+    //Families are the high nibble of the opcode, null (unknown opcodes) is listed separately
+    uint64_t families[16]{};
+    for (unsigned int handler = OP_00E0; handler < OP_NULL; handler++) {
+        char family = handler_names[handler][0];
+        families[family <= '9' ? family - '0' : family - 'A' + 10] += profile.handler_counts[handler];
+    }
+
+    fprintf(out, "family  count         share\n");
+    for (unsigned int family = 0; family < 16; family++) {
+        if (!families[family]) continue;
+        fprintf(out, "%Xxxx    %-12llu  %5.1f%%\n", family, static_cast<unsigned long long>(families[family]), 100.0 * families[family] / total);
+    }
+
+    fprintf(out, "handler count         share\n");
+    for (unsigned int handler = OP_00E0; handler < HANDLER_COUNT; handler++) {
+        if (!profile.handler_counts[handler]) continue;
+        fprintf(out, "%-7s %-12llu  %5.1f%%\n", handler_names[handler],
+            static_cast<unsigned long long>(profile.handler_counts[handler]), 100.0 * profile.handler_counts[handler] / total);
+    }
+
+    //Hottest addresses, with the handler currently decoded there
+    std::vector<uint16_t> addresses;
+    for (unsigned int address = 0; address < Profile::PC_SLOTS; address++) {
+        if (profile.pc_hits[address]) addresses.push_back(address);
+    }
+    size_t shown = std::min<size_t>(top_addresses, addresses.size());
+    std::partial_sort(addresses.begin(), addresses.begin() + shown, addresses.end(), [this](uint16_t a, uint16_t b) {
+        return profile.pc_hits[a] > profile.pc_hits[b];
+    });
+
+    fprintf(out, "address count         share  opcode\n");
+    for (size_t i = 0; i < shown; i++) {
+        uint16_t address = addresses[i];
+        uint16_t opcode = (read(address) << 8u) | read(address + 1);
+        fprintf(out, "%03X     %-12llu  %5.1f%%  %04X\n", address,
+            static_cast<unsigned long long>(profile.pc_hits[address]), 100.0 * profile.pc_hits[address] / total, opcode);
+    }
+}
+
+#endif
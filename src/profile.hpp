@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+//Hot-path counters collected by Chip8 when built with CHIP8_PROFILE
+//Without the define none of this is referenced by the core, so it costs nothing
+struct Profile {
+    static const unsigned int MAX_HANDLERS = 80;
+    static const unsigned int PC_SLOTS = 4096;
+
+    //Executions per decoded handler (Chip8::Handler index)
+    uint64_t handler_counts[MAX_HANDLERS];
+    //Executions per instruction address
+    uint64_t pc_hits[PC_SLOTS];
+
+    uint64_t instructions;
+
+    //Instructions per frame, a frame ends at each tickTimers()
+    uint64_t frames;
+    uint64_t frame_start;
+    uint64_t frame_min;
+    uint64_t frame_max;
+
+    //Wall time inside run() and the part of it spent in Dxyn
+    uint64_t run_ns;
+    uint64_t draw_ns;
+};
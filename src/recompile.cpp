@@ -0,0 +1,260 @@
+#include "rom.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+//Ahead-of-time recompiler
+//Disassembles a CHIP-8 ROM, recovers its control-flow graph from START_ADDRESS and writes C++
+//with one function per basic block, see aot.hpp for how the result is linked and run
+//Usage: recompile <ROM> <output.cpp>
+
+namespace {
+
+//Longest block, same as the JIT so budgets split the same way
+const unsigned int max_block_length = 32;
+
+//How an instruction leaves the block
+enum class Flow {
+    Next,       //Falls through
+    Jump,       //1nnn
+    Call,       //2nnn, returns to the next instruction
+    Return,     //00EE
+    Computed,   //Bnnn, target only known at run time
+    Skip,       //3xkk, 4xkk, 5xy0, 9xy0, Ex9E, ExA1
+    Wait,       //Fx0A, re-executes itself until a key is held
+    Write       //Fx33, Fx55, may overwrite code
+};
+
+Flow flowOf(uint16_t opcode) {
+    uint8_t kk = opcode & 0xFFu;
+    switch (opcode >> 12) {
+        case 0x0: return (opcode & 0xFu) == 0xE ? Flow::Return : Flow::Next;
+        case 0x1: return Flow::Jump;
+        case 0x2: return Flow::Call;
+        case 0x3: case 0x4: case 0x5: case 0x9: return Flow::Skip;
+        case 0xB: return Flow::Computed;
+        case 0xE: return ((opcode & 0xFu) == 0x1 || (opcode & 0xFu) == 0xE) ? Flow::Skip : Flow::Next;
+        case 0xF:
+            if (kk == 0x0A) return Flow::Wait;
+            if (kk == 0x33 || kk == 0x55) return Flow::Write;
+            return Flow::Next;
+        default: return Flow::Next;
+    }
+}
+
+//Mnemonic for the listing comments, with the CHIP-8 decoding used by Chip8::buildTables()
+std::string disassemble(uint16_t opcode) {
+    char text[32];
+    unsigned int nnn = opcode & 0xFFFu, x = (opcode >> 8) & 0xFu, y = (opcode >> 4) & 0xFu, kk = opcode & 0xFFu, n = opcode & 0xFu;
+    const char* alu[16] = {"LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN", nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr};
+
+    switch (opcode >> 12) {
+        case 0x0:
+            if (n == 0x0) return "CLS";
+            if (n == 0xE) return "RET";
+            break;
+        case 0x1: snprintf(text, sizeof(text), "JP %03X", nnn); return text;
+        case 0x2: snprintf(text, sizeof(text), "CALL %03X", nnn); return text;
+        case 0x3: snprintf(text, sizeof(text), "SE V%X, %02X", x, kk); return text;
+        case 0x4: snprintf(text, sizeof(text), "SNE V%X, %02X", x, kk); return text;
+        case 0x5: snprintf(text, sizeof(text), "SE V%X, V%X", x, y); return text;
+        case 0x6: snprintf(text, sizeof(text), "LD V%X, %02X", x, kk); return text;
+        case 0x7: snprintf(text, sizeof(text), "ADD V%X, %02X", x, kk); return text;
+        case 0x8:
+            if (!alu[n]) break;
+            snprintf(text, sizeof(text), "%s V%X, V%X", alu[n], x, y);
+            return text;
+        case 0x9: snprintf(text, sizeof(text), "SNE V%X, V%X", x, y); return text;
+        case 0xA: snprintf(text, sizeof(text), "LD I, %03X", nnn); return text;
+        case 0xB: snprintf(text, sizeof(text), "JP V0, %03X", nnn); return text;
+        case 0xC: snprintf(text, sizeof(text), "RND V%X, %02X", x, kk); return text;
+        case 0xD: snprintf(text, sizeof(text), "DRW V%X, V%X, %X", x, y, n); return text;
+        case 0xE:
+            if (n == 0xE) { snprintf(text, sizeof(text), "SKP V%X", x); return text; }
+            if (n == 0x1) { snprintf(text, sizeof(text), "SKNP V%X", x); return text; }
+            break;
+        case 0xF: {
+            const char* format = nullptr;
+            switch (kk) {
+                case 0x07: format = "LD V%X, DT"; break;
+                case 0x0A: format = "LD V%X, K"; break;
+                case 0x15: format = "LD DT, V%X"; break;
+                case 0x18: format = "LD ST, V%X"; break;
+                case 0x1E: format = "ADD I, V%X"; break;
+                case 0x29: format = "LD F, V%X"; break;
+                case 0x33: format = "LD B, V%X"; break;
+                case 0x55: format = "LD [I], V%X"; break;
+                case 0x65: format = "LD V%X, [I]"; break;
+            }
+            if (!format) break;
+            snprintf(text, sizeof(text), format, x);
+            return text;
+        }
+    }
+    snprintf(text, sizeof(text), "DW %04X", opcode);
+    return text;
+}
+
+struct Block {
+    uint16_t address;
+    std::vector<uint16_t> opcodes;
+};
+
+//Walks the program from START_ADDRESS, starting a block at every jump, call and return target
+//and after every instruction that ends a block
+//Computed jumps and targets outside the program get no block and are interpreted at run time
+std::vector<Block> recover(const std::vector<uint8_t>& program, unsigned int& unresolved) {
+    const unsigned int end = START_ADDRESS + program.size();
+    auto fetch = [&](unsigned int address) {
+        return static_cast<uint16_t>((program[address - START_ADDRESS] << 8u) | program[address + 1 - START_ADDRESS]);
+    };
+
+    std::set<unsigned int> visited{START_ADDRESS};
+    std::vector<unsigned int> pending{START_ADDRESS};
+    std::vector<Block> blocks;
+    unresolved = 0;
+
+    auto leader = [&](unsigned int address) {
+        if (address < START_ADDRESS || address + 2 > end) unresolved++;
+        else if (visited.insert(address).second) pending.push_back(address);
+    };
+
+    while (!pending.empty()) {
+        unsigned int address = pending.back();
+        pending.pop_back();
+        if (address + 2 > end) continue;
+
+        Block block{static_cast<uint16_t>(address), {}};
+        unsigned int pc = address;
+        bool done = false;
+
+        while (!done) {
+            uint16_t opcode = fetch(pc);
+            unsigned int next = pc + 2;
+            block.opcodes.push_back(opcode);
+            done = true;
+
+            switch (flowOf(opcode)) {
+                case Flow::Next:
+                    done = false;
+                    break;
+                case Flow::Jump:
+                    leader(opcode & 0xFFFu);
+                    break;
+                case Flow::Call:
+                    leader(opcode & 0xFFFu);
+                    leader(next);
+                    break;
+                case Flow::Return:
+                    break;
+                case Flow::Computed:
+                    unresolved++;
+                    break;
+                case Flow::Skip:
+                    leader(next);
+                    leader(next + 2);
+                    break;
+                case Flow::Wait:
+                    leader(pc);
+                    leader(next);
+                    break;
+                case Flow::Write:
+                    leader(next);
+                    break;
+            }
+
+            if (!done && (block.opcodes.size() == max_block_length || next + 2 > end)) {
+                leader(next);
+                done = true;
+            }
+            pc = next;
+        }
+        blocks.push_back(block);
+    }
+
+    std::sort(blocks.begin(), blocks.end(), [](const Block& a, const Block& b) { return a.address < b.address; });
+    return blocks;
+}
+
+void usage(const char* program) {
+    std::cerr << "Usage: " << program << " <ROM> <output.cpp>\n";
+    std::exit(EXIT_FAILURE);
+}
+
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) usage(argv[0]);
+    std::string rom = argv[1];
+
+    RomError error = RomError::None;
+    std::shared_ptr<const RomImage> image = RomCache::global().load(rom, &error);
+    if (!image) {
+        std::cerr << "Could not load " << rom << ": " << romErrorString(error) << "\n";
+        return EXIT_FAILURE;
+    }
+    if (image->size > MEM_SIZE - START_ADDRESS) {
+        std::cerr << rom << " doesn't fit in CHIP-8 memory, only CHIP-8 programs can be recompiled\n";
+        return EXIT_FAILURE;
+    }
+
+    unsigned int unresolved = 0;
+    std::vector<Block> blocks = recover(image->program, unresolved);
+
+    //File name without directories, escaped for a string literal
+    std::string name;
+    for (char c : rom.substr(rom.find_last_of("/\\") + 1)) {
+        if (c == '"' || c == '\\') name += '\\';
+        name += c;
+    }
+    std::ofstream out(argv[2]);
+    if (!out.is_open()) {
+        std::cerr << "Could not write " << argv[2] << "\n";
+        return EXIT_FAILURE;
+    }
+
+    char line[128];
+    out << "//Generated by recompile from " << name << ", do not edit\n";
+    out << "#include \"aot.hpp\"\n\nnamespace {\n\nconst uint8_t rom[] = {";
+    for (size_t i = 0; i < image->program.size(); i++) {
+        snprintf(line, sizeof(line), "%s0x%02X,", i % 16 ? " " : "\n    ", image->program[i]);
+        out << line;
+    }
+    out << "\n};\n";
+
+    size_t instructions = 0;
+    for (const Block& block : blocks) {
+        snprintf(line, sizeof(line), "\nvoid block_%03X(Chip8& chip8) {\n", block.address);
+        out << line;
+        for (size_t i = 0; i < block.opcodes.size(); i++) {
+            unsigned int address = block.address + 2 * i;
+            snprintf(line, sizeof(line), "    Aot::step<0x%04X>(chip8); //%03X %s\n",
+                block.opcodes[i], address, disassemble(block.opcodes[i]).c_str());
+            out << line;
+        }
+        out << "}\n";
+        instructions += block.opcodes.size();
+    }
+
+    out << "\nconst AotBlock blocks[] = {\n";
+    for (const Block& block : blocks) {
+        snprintf(line, sizeof(line), "    {0x%03X, %zu, &block_%03X},\n", block.address, block.opcodes.size(), block.address);
+        out << line;
+    }
+    out << "};\n\n";
+    out << "const AotProgram program{\"" << name << "\", rom, sizeof(rom), blocks, sizeof(blocks) / sizeof(blocks[0])};\n";
+    out << "const bool registered = Aot::add(program);\n\n}\n";
+
+    if (!out.good()) {
+        std::cerr << "Could not write " << argv[2] << "\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << name << ": " << blocks.size() << " blocks, " << instructions << " instructions, "
+        << unresolved << " computed or out-of-program targets\n";
+    return 0;
+}
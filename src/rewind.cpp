@@ -0,0 +1,99 @@
+#include "rewind.hpp"
+
+namespace {
+
+void writeVarint(std::vector<uint8_t>& out, size_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value) | 0x80u);
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+size_t readVarint(const uint8_t*& in) {
+    size_t value = 0;
+    unsigned int shift = 0;
+    while (*in & 0x80u) {
+        value |= static_cast<size_t>(*in++ & 0x7Fu) << shift;
+        shift += 7;
+    }
+    value |= static_cast<size_t>(*in++) << shift;
+    return value;
+}
+
+}
+
+RewindBuffer::RewindBuffer(size_t capacity)
+    :capacity(capacity) {}
+
+void RewindBuffer::push(const Snapshot& snapshot) {
+    if (has_newest && capacity > 0) {
+        std::vector<uint8_t> delta;
+        encode(reinterpret_cast<const uint8_t*>(&newest), reinterpret_cast<const uint8_t*>(&snapshot), sizeof(Snapshot), delta);
+        delta_bytes += delta.size();
+        deltas.push_back(std::move(delta));
+
+        if (deltas.size() > capacity) {
+            delta_bytes -= deltas.front().size();
+            deltas.pop_front();
+        }
+    }
+
+    memcpy(&newest, &snapshot, sizeof(Snapshot));
+    has_newest = true;
+}
+
+bool RewindBuffer::pop(Snapshot& snapshot) {
+    if (deltas.empty()) return false;
+
+    apply(deltas.back(), reinterpret_cast<uint8_t*>(&newest));
+    delta_bytes -= deltas.back().size();
+    deltas.pop_back();
+
+    memcpy(&snapshot, &newest, sizeof(Snapshot));
+    return true;
+}
+
+void RewindBuffer::clear() {
+    deltas.clear();
+    delta_bytes = 0;
+    has_newest = false;
+}
+
+size_t RewindBuffer::size() const {
+    return deltas.size();
+}
+
+size_t RewindBuffer::memoryUsage() const {
+    return delta_bytes;
+}
+
+//Delta format: repeated (zero run length, literal length, literal XOR bytes), lengths as varints
+void RewindBuffer::encode(const uint8_t* previous, const uint8_t* current, size_t size, std::vector<uint8_t>& out) {
+    size_t i = 0;
+    while (i < size) {
+        size_t zeros = 0;
+        while (i + zeros < size && previous[i + zeros] == current[i + zeros]) zeros++;
+        i += zeros;
+
+        size_t literal = 0;
+        while (i + literal < size && previous[i + literal] != current[i + literal]) literal++;
+
+        if (literal == 0) break;
+        writeVarint(out, zeros);
+        writeVarint(out, literal);
+        for (size_t j = 0; j < literal; j++) out.push_back(previous[i + j] ^ current[i + j]);
+        i += literal;
+    }
+}
+
+void RewindBuffer::apply(const std::vector<uint8_t>& delta, uint8_t* state) {
+    const uint8_t* in = delta.data();
+    const uint8_t* end = in + delta.size();
+
+    while (in < end) {
+        state += readVarint(in);
+        size_t literal = readVarint(in);
+        for (size_t j = 0; j < literal; j++) *state++ ^= *in++;
+    }
+}
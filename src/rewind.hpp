@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "chip8.hpp"
+
+//Rewind history of per-frame snapshots
+//Only the newest snapshot is kept in full. Each older frame is stored as the XOR of
+//two consecutive snapshots, run-length encoded: consecutive frames differ in a few
+//bytes, so an entry is usually tens of bytes instead of a full snapshot.
+//XOR is its own inverse, so stepping back is newest ^= delta.
+class RewindBuffer {
+    public:
+        //Keeps at most capacity frames of history (e.g. 60 * seconds)
+        explicit RewindBuffer(size_t capacity);
+
+        void push(const Snapshot& snapshot);
+        //Steps one frame back, returns false when history is exhausted
+        bool pop(Snapshot& snapshot);
+        void clear();
+
+        size_t size() const;
+        //Bytes held by encoded deltas
+        size_t memoryUsage() const;
+
+    private:
+        size_t capacity;
+        Snapshot newest{};
+        bool has_newest{};
+        std::deque<std::vector<uint8_t>> deltas;
+        size_t delta_bytes{};
+
+        static void encode(const uint8_t* previous, const uint8_t* current, size_t size, std::vector<uint8_t>& out);
+        static void apply(const std::vector<uint8_t>& delta, uint8_t* state);
+};
@@ -0,0 +1,209 @@
+#include "rom.hpp"
+#include <cctype>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+//Read-only view of a whole file, unmapped on destruction
+class MappedFile {
+    public:
+        explicit MappedFile(const std::string& filename) {
+#if defined(_WIN32)
+            file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) return;
+            opened = true;
+
+            LARGE_INTEGER filesize;
+            if (!GetFileSizeEx(file, &filesize)) {
+                failed = true;
+                return;
+            }
+            if (filesize.QuadPart == 0) return;
+            length = static_cast<size_t>(filesize.QuadPart);
+
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping) view = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            failed = !view;
+#else
+            int fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0) return;
+            opened = true;
+
+            struct stat info;
+            if (fstat(fd, &info) != 0) failed = true;
+            else if (info.st_size > 0) {
+                length = static_cast<size_t>(info.st_size);
+                void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped != MAP_FAILED) view = static_cast<const uint8_t*>(mapped);
+                failed = !view;
+            }
+            close(fd);
+#endif
+            if (!view) length = 0;
+        }
+
+        ~MappedFile() {
+#if defined(_WIN32)
+            if (view) UnmapViewOfFile(view);
+            if (mapping) CloseHandle(mapping);
+            if (opened) CloseHandle(file);
+#else
+            if (view) munmap(const_cast<uint8_t*>(view), length);
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool opened{};
+        //Opened but not mapped, as opposed to an empty file
+        bool failed{};
+        const uint8_t* view{};
+        size_t length{};
+
+    private:
+#if defined(_WIN32)
+        HANDLE file{INVALID_HANDLE_VALUE};
+        HANDLE mapping{};
+#endif
+};
+
+}
+
+bool loadQuirksFile(const std::string& rom_filename, Quirks& quirks) {
+    std::ifstream file(rom_filename + ".quirks");
+    if (!file.is_open()) return true;
+
+    std::string line;
+    std::getline(file, line);
+    while (!line.empty() && isspace(static_cast<unsigned char>(line.back()))) line.pop_back();
+    return parseQuirks(line, quirks);
+}
+
+const char* romErrorString(RomError error) {
+    switch (error) {
+        case RomError::None: return "no error";
+        case RomError::OpenFailed: return "could not open file";
+        case RomError::ReadFailed: return "could not read file";
+        case RomError::Empty: return "file is empty";
+        case RomError::TooLarge: return "program larger than 65024 bytes";
+    }
+    return "unknown error";
+}
+
+uint64_t hashRom(const uint8_t* data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+RomCache& RomCache::global() {
+    static RomCache cache;
+    return cache;
+}
+
+//Modification time in the finest unit the platform reports
+bool RomCache::stampFile(const std::string& filename, FileStamp& stamp) {
+#if defined(_WIN32)
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &info)) return false;
+    stamp.size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32u) | info.nFileSizeLow;
+    stamp.modified = static_cast<int64_t>((static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32u) | info.ftLastWriteTime.dwLowDateTime);
+#else
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0) return false;
+    stamp.size = static_cast<uint64_t>(info.st_size);
+#if defined(__linux__)
+    stamp.modified = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#else
+    stamp.modified = static_cast<int64_t>(info.st_mtime);
+#endif
+#endif
+    return true;
+}
+
+std::shared_ptr<const RomImage> RomCache::load(const std::string& filename, RomError* error) {
+    //A cached path is only reused while the file's size and modification time are unchanged
+    FileStamp stamp;
+    if (!stampFile(filename, stamp)) {
+        if (error) *error = RomError::OpenFailed;
+        return nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto found = by_path.find(filename);
+        if (found != by_path.end() && found->second.stamp == stamp) {
+            if (error) *error = RomError::None;
+            return found->second.image;
+        }
+    }
+
+    //File I/O happens outside the lock, two threads racing on a new path just map it twice
+    MappedFile file(filename);
+    if (!file.opened || file.failed) {
+        if (error) *error = file.opened ? RomError::ReadFailed : RomError::OpenFailed;
+        return nullptr;
+    }
+
+    std::shared_ptr<const RomImage> image = load(file.view, file.length, error);
+    if (image) {
+        std::lock_guard<std::mutex> guard(lock);
+        by_path[filename] = {stamp, image};
+    }
+    return image;
+}
+
+std::shared_ptr<const RomImage> RomCache::load(const uint8_t* data, size_t size, RomError* error) {
+    if (size == 0) {
+        if (error) *error = RomError::Empty;
+        return nullptr;
+    }
+    if (size > XO_MEM_SIZE - START_ADDRESS) {
+        if (error) *error = RomError::TooLarge;
+        return nullptr;
+    }
+
+    uint64_t hash = hashRom(data, size);
+    std::lock_guard<std::mutex> guard(lock);
+
+    //Hash collisions fall through to a fresh image that replaces the old entry
+    auto found = by_hash.find(hash);
+    if (found != by_hash.end() && found->second->size == size
+        && memcmp(found->second->program.data(), data, size) == 0) {
+        if (error) *error = RomError::None;
+        return found->second;
+    }
+
+    std::shared_ptr<RomImage> image(new RomImage());
+    memcpy(&image->memory[FONTSET_START_ADDRESS], FONTSET, FONTSET_SIZE);
+    if (size <= MEM_SIZE - START_ADDRESS) memcpy(&image->memory[START_ADDRESS], data, size);
+    image->program.assign(data, data + size);
+    image->size = size;
+    image->hash = hash;
+
+    by_hash[hash] = image;
+    if (error) *error = RomError::None;
+    return image;
+}
+
+void RomCache::clear() {
+    std::lock_guard<std::mutex> guard(lock);
+    by_path.clear();
+    by_hash.clear();
+}
+
+size_t RomCache::size() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return by_hash.size();
+}
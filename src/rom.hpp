@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "chip8.hpp"
+
+enum class RomError {
+    None,
+    OpenFailed,
+    //Opened, but its size couldn't be read or it couldn't be mapped
+    ReadFailed,
+    Empty,
+    TooLarge
+};
+
+const char* romErrorString(RomError error);
+
+//Validated program prepared as a full 4 KB memory image (font at 0x50, program at 0x200)
+//CHIP-8 instances load it as one block write of memory, which also drops decoded instructions,
+//instead of reading the file again
+//Programs too large for 4 KB (XO-CHIP only) leave memory holding just the font
+struct RomImage {
+    uint8_t memory[MEM_SIZE];
+    std::vector<uint8_t> program;
+    size_t size;
+    //FNV-1a of the program bytes
+    uint64_t hash;
+};
+
+uint64_t hashRom(const uint8_t* data, size_t size);
+
+//Per-ROM quirks: "<ROM file>.quirks" next to a ROM holds a parseQuirks() line such as "vip"
+//Leaves quirks alone if there is no such file, returns false if it doesn't parse
+bool loadQuirksFile(const std::string& rom_filename, Quirks& quirks);
+
+//Process-wide cache of prepared images, safe to use from several threads
+//Files are memory-mapped and read once per path, size and modification time, so a file
+//rewritten on disk is read again; images are shared by content hash, so the same program
+//loaded from different paths or buffers is stored once
+class RomCache {
+    public:
+        static RomCache& global();
+
+        //Returns nullptr and sets error if the file can't be opened or doesn't fit in XO-CHIP memory
+        std::shared_ptr<const RomImage> load(const std::string& filename, RomError* error = nullptr);
+        std::shared_ptr<const RomImage> load(const uint8_t* data, size_t size, RomError* error = nullptr);
+
+        void clear();
+        size_t size() const;
+
+    private:
+        //Size and modification time of a file when it was read
+        struct FileStamp {
+            uint64_t size;
+            int64_t modified;
+            bool operator==(const FileStamp& other) const { return size == other.size && modified == other.modified; }
+        };
+        struct PathEntry {
+            FileStamp stamp;
+            std::shared_ptr<const RomImage> image;
+        };
+
+        static bool stampFile(const std::string& filename, FileStamp& stamp);
+
+        mutable std::mutex lock;
+        std::unordered_map<std::string, PathEntry> by_path;
+        std::unordered_map<uint64_t, std::shared_ptr<const RomImage>> by_hash;
+};
@@ -0,0 +1,168 @@
+#include "scheduler.hpp"
+#include <algorithm>
+#include <thread>
+
+    const std::chrono::nanoseconds frame_period(1000000000 / Scheduler::FRAME_RATE);
+    //Falling further behind than this (window drag, debugger) drops the backlog instead of catching up
+    const unsigned int max_lag_frames = 5;
+
+Scheduler::Scheduler(Chip8& chip8, unsigned int instructions_per_frame)
+    :chip8(chip8),
+    instructions_per_frame(instructions_per_frame),
+    deadline(Clock::now() + frame_period) {}
+
+void Scheduler::setTurbo(bool enabled, unsigned int frame_skip) {
+    turbo = enabled;
+    this->frame_skip = frame_skip ? frame_skip : 1;
+
+    //Leaving turbo restarts pacing from now rather than sleeping off the fast-forwarded time
+    if (!turbo) deadline = Clock::now() + frame_period;
+}
+
+void Scheduler::setCycleBudget(uint32_t cycles_per_frame) {
+    this->cycles_per_frame = cycles_per_frame;
+    overshoot = 0;
+}
+
+bool Scheduler::getTurbo() const {
+    return turbo;
+}
+
+void Scheduler::setInput(InputRing* input) {
+    this->input = input;
+    last_run = 0;
+}
+
+void Scheduler::setRecorder(MovieWriter* recorder) {
+    this->recorder = recorder;
+}
+
+void Scheduler::applyEvent(const InputEvent& event, uint64_t cycle) {
+    uint16_t bit = 1u << event.key;
+    if (recorder && chip8.keypad[event.key] != event.pressed) recorder->keyEvent(cycle, event.key, event.pressed);
+    chip8.keypad[event.key] = event.pressed;
+
+    if (event.pressed) {
+        pending_press[event.key] = event.timestamp;
+        pending_keys |= bit;
+        if (!applied_press || event.timestamp < applied_press) applied_press = event.timestamp;
+    }
+    else {
+        pending_keys &= ~bit;
+    }
+}
+
+void Scheduler::applyPendingInput() {
+    if (!input) return;
+
+    InputEvent event;
+    while (input->pop(event)) applyEvent(event, instructions);
+}
+
+unsigned int Scheduler::runSlice(unsigned int budget) {
+    if (!cycles_per_frame) {
+        unsigned int executed = chip8.run(budget);
+        instructions += executed;
+        return executed;
+    }
+
+    uint32_t used;
+    instructions += chip8.runCycles(budget, used);
+    cycles += used;
+    return used;
+}
+
+//Runs a slice of the frame and records latency for pending presses the program tested
+unsigned int Scheduler::runObserved(unsigned int budget) {
+    unsigned int spent = runSlice(budget);
+
+    uint16_t observed = chip8.takeObservedKeys() & pending_keys;
+    if (observed) {
+        uint64_t now = inputTimestamp();
+        for (unsigned int key = 0; key < KEY_COUNT; key++) {
+            if (observed & (1u << key)) key_latency.record(now - pending_press[key]);
+        }
+        pending_keys &= ~observed;
+    }
+    return spent;
+}
+
+bool Scheduler::runFrame() {
+    Clock::time_point start = Clock::now();
+    unsigned int budget = cycles_per_frame ? cycles_per_frame - std::min(overshoot, cycles_per_frame) : instructions_per_frame;
+    unsigned int spent = 0;
+
+    if (!input) {
+        spent = runSlice(budget);
+    }
+    else {
+        //Frames run in a burst at their start, so this frame replays the input of the period just past
+        uint64_t now = inputTimestamp();
+        uint64_t period = std::chrono::duration_cast<std::chrono::nanoseconds>(frame_period).count();
+        if (!last_run || now - last_run > period * max_lag_frames) last_run = now - period;
+        uint64_t window = now - last_run;
+
+        InputEvent event;
+        while (input->peek(event) && event.timestamp <= now) {
+            uint64_t offset = event.timestamp > last_run ? event.timestamp - last_run : 0;
+            unsigned int boundary = static_cast<unsigned int>(offset * budget / window);
+
+            if (boundary > spent) spent += runObserved(boundary - spent);
+            applyEvent(event, instructions);
+            input->pop(event);
+        }
+        if (budget > spent) spent += runObserved(budget - spent);
+
+        last_run = now;
+    }
+    if (cycles_per_frame) overshoot = spent - budget;
+
+    chip8.tickTimers();
+    frames++;
+    if (recorder) recorder->flush();
+    frame_time.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+
+    return !turbo || frames % frame_skip == 0;
+}
+
+void Scheduler::waitForNextFrame() {
+    if (turbo) return;
+
+    Clock::time_point now = Clock::now();
+    if (now > deadline + frame_period * max_lag_frames) deadline = now;
+
+    std::this_thread::sleep_until(deadline);
+    std::chrono::nanoseconds late = Clock::now() - deadline;
+    wake_lateness.record(late.count() > 0 ? late.count() : 0);
+    deadline += frame_period;
+}
+
+uint64_t Scheduler::frameCount() const {
+    return frames;
+}
+
+uint64_t Scheduler::instructionCount() const {
+    return instructions;
+}
+
+uint64_t Scheduler::cycleCount() const {
+    return cycles;
+}
+
+const LatencyStats& Scheduler::frameTime() const {
+    return frame_time;
+}
+
+const LatencyStats& Scheduler::wakeLateness() const {
+    return wake_lateness;
+}
+
+const LatencyStats& Scheduler::keyLatency() const {
+    return key_latency;
+}
+
+uint64_t Scheduler::takeAppliedPress() {
+    uint64_t press = applied_press;
+    applied_press = 0;
+    return press;
+}
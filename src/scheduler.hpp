@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include "chip8.hpp"
+#include "input.hpp"
+#include "movie.hpp"
+
+//Fixed-timestep frame scheduler
+//Each 60 Hz frame runs a fixed instruction budget, or a budget of COSMAC VIP machine cycles,
+//then ticks the timers, so game speed no longer depends on how fast the host executes instructions
+class Scheduler {
+    public:
+        static const unsigned int FRAME_RATE = 60;
+
+        Scheduler(Chip8& chip8, unsigned int instructions_per_frame);
+
+        //Frames spend cycles_per_frame VIP machine cycles (Chip8::runCycles) instead of a fixed
+        //instruction count, so each instruction takes its time on the VIP. 0 goes back to instructions
+        //The last instruction's overshoot comes out of the next frame's budget
+        void setCycleBudget(uint32_t cycles_per_frame);
+
+        //Fast-forward: frames run back to back without sleeping, only every frame_skip-th frame is rendered
+        void setTurbo(bool enabled, unsigned int frame_skip = 1);
+        bool getTurbo() const;
+
+        //Key events are taken from input instead of the caller writing chip8.keypad
+        //Events are applied between instructions in proportion to where their timestamp
+        //falls in the previous frame period, so taps shorter than a frame are still seen
+        void setInput(InputRing* input);
+        //Applies all queued events immediately, for when frames aren't running (rewind)
+        void applyPendingInput();
+        //Records every keypad change with the instruction count it was applied at
+        void setRecorder(MovieWriter* recorder);
+
+        //Runs one frame of instructions and ticks timers
+        //Returns true if this frame should be presented
+        bool runFrame();
+
+        //Sleeps until the next frame deadline, returns immediately in turbo mode
+        void waitForNextFrame();
+
+        uint64_t frameCount() const;
+        uint64_t instructionCount() const;
+        //VIP machine cycles spent under setCycleBudget()
+        uint64_t cycleCount() const;
+
+        //Emulation-side pacing: host time spent inside runFrame(), and how late
+        //waitForNextFrame() woke up relative to the frame deadline
+        const LatencyStats& frameTime() const;
+        const LatencyStats& wakeLateness() const;
+
+        //Time from a key press being read to the program first testing it (Ex9E/ExA1/Fx0A)
+        const LatencyStats& keyLatency() const;
+        //Timestamp of the earliest press applied since the last call, 0 if none
+        uint64_t takeAppliedPress();
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        Chip8& chip8;
+        unsigned int instructions_per_frame;
+        uint32_t cycles_per_frame{};
+        uint32_t overshoot{};
+
+        bool turbo{};
+        unsigned int frame_skip{1};
+
+        Clock::time_point deadline;
+        uint64_t frames{};
+        uint64_t instructions{};
+        uint64_t cycles{};
+
+        InputRing* input{};
+        MovieWriter* recorder{};
+        uint64_t last_run{};
+        //Press timestamp per key not yet seen by the program, 0 once observed or released
+        uint64_t pending_press[KEY_COUNT]{};
+        uint16_t pending_keys{};
+        uint64_t applied_press{};
+        LatencyStats key_latency;
+        LatencyStats frame_time;
+        LatencyStats wake_lateness;
+
+        void applyEvent(const InputEvent& event, uint64_t cycle);
+        //Spends up to budget instructions, or cycles under a cycle budget, returns how many were spent
+        unsigned int runSlice(unsigned int budget);
+        unsigned int runObserved(unsigned int budget);
+};
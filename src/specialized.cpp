@@ -0,0 +1,50 @@
+#include "specialized.hpp"
+#include <utility>
+
+namespace {
+
+//Opcode whose handler does nothing, every invalid opcode maps to it
+const uint16_t null_opcode = 0x0001;
+
+//Maps an opcode to one representative of the opcodes with the same CHIP-8 semantics, mirroring buildTables()
+//Operands an instruction ignores are dropped, so e.g. all 256 0xy0 share the 00E0 handler
+//and the table instantiates about 44K handlers instead of 64K
+constexpr uint16_t canonical(uint16_t opcode) {
+    uint8_t n = opcode & 0x000Fu;
+    uint8_t kk = opcode & 0x00FFu;
+
+    switch (opcode >> 12) {
+        case 0x0:
+            if (n == 0x0) return 0x00E0;
+            if (n == 0xE) return 0x00EE;
+            return null_opcode;
+        case 0x5:
+        case 0x9:
+            return opcode & 0xFFF0u;
+        case 0x8:
+            return (n <= 0x7 || n == 0xE) ? opcode : null_opcode;
+        case 0xE:
+            if (n == 0x1) return (opcode & 0xFF00u) | 0xA1u;
+            if (n == 0xE) return (opcode & 0xFF00u) | 0x9Eu;
+            return null_opcode;
+        case 0xF:
+            switch (kk) {
+                case 0x07: case 0x0A: case 0x15: case 0x18: case 0x1E:
+                case 0x29: case 0x33: case 0x55: case 0x65:
+                    return opcode;
+                default:
+                    return null_opcode;
+            }
+        default:
+            return opcode;
+    }
+}
+
+template <size_t... Opcodes>
+constexpr std::array<Specialized::Handler, 0x10000> makeTable(std::index_sequence<Opcodes...>) {
+    return {{&Specialized::execute<canonical(Opcodes)>...}};
+}
+
+}
+
+const std::array<Specialized::Handler, 0x10000> Specialized::handlers = makeTable(std::make_index_sequence<0x10000>());
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "chip8.hpp"
+
+//Compile-time specialized CHIP-8 handlers, one per opcode value with the operands as template arguments
+//make SPECIALIZED=1 (CHIP8_SPECIALIZED) builds a flat table of all of them, indexed by the raw opcode,
+//which replaces the decode tables and decode cache. Opcodes that behave identically share one handler,
+//see canonical() in specialized.cpp. Recompiled ROMs (aot.hpp) instantiate only the opcodes they contain
+struct Specialized {
+    typedef void (*Handler)(Chip8& chip8);
+
+    //Indexed by opcode, constant-initialized
+    static const std::array<Handler, 0x10000> handlers;
+
+    template <uint16_t Opcode>
+    static void execute(Chip8& chip8);
+
+    //Runs one of the interpreter's handlers on a decoded instruction that is a compile-time constant
+    template <uint16_t Opcode, void (Chip8::*Handler)()>
+    static void delegate(Chip8& chip8);
+};
+
+template <uint16_t Opcode, void (Chip8::*Handler)()>
+void Specialized::delegate(Chip8& chip8) {
+    static constexpr Instruction decoded{
+        Opcode & 0x0FFFu, (Opcode >> 8) & 0xFu, (Opcode >> 4) & 0xFu, Opcode & 0xFFu, Opcode & 0xFu, 0, 2, 0, 1
+    };
+    chip8.inst = &decoded;
+    (chip8.*Handler)();
+}
+
+//Short register and control flow ops are written out with constant operands
+//Memory, display, keypad, stack and RNG ops delegate, they are long enough that decoding isn't their cost
+//Behavior is the CHIP-8 default quirk set, Chip8::setEngine() doesn't select these under others
+template <uint16_t Opcode>
+void Specialized::execute(Chip8& chip8) {
+    constexpr uint16_t nnn = Opcode & 0x0FFFu;
+    constexpr uint8_t x = (Opcode >> 8) & 0xFu;
+    constexpr uint8_t y = (Opcode >> 4) & 0xFu;
+    constexpr uint8_t kk = Opcode & 0xFFu;
+    constexpr uint8_t n = Opcode & 0xFu;
+    uint8_t* registers = chip8.registers;
+
+    //Decoded like the CHIP-8 tables in Chip8::buildTables(), so any 0xy0 clears and any 0xyE returns
+    if constexpr ((Opcode & 0xF00Fu) == 0x0000) delegate<Opcode, &Chip8::op_00e0>(chip8);
+    else if constexpr ((Opcode & 0xF00Fu) == 0x000E) delegate<Opcode, &Chip8::op_00ee>(chip8);
+    else if constexpr ((Opcode >> 12) == 0x1) chip8.program_counter = nnn;
+    else if constexpr ((Opcode >> 12) == 0x2) delegate<Opcode, &Chip8::op_2nnn>(chip8);
+    else if constexpr ((Opcode >> 12) == 0x3) {
+        if (registers[x] == kk) chip8.program_counter += 2;
+    }
+    else if constexpr ((Opcode >> 12) == 0x4) {
+        if (registers[x] != kk) chip8.program_counter += 2;
+    }
+    else if constexpr ((Opcode >> 12) == 0x5) {
+        if (registers[x] == registers[y]) chip8.program_counter += 2;
+    }
+    else if constexpr ((Opcode >> 12) == 0x6) registers[x] = kk;
+    else if constexpr ((Opcode >> 12) == 0x7) registers[x] += kk;
+    else if constexpr ((Opcode >> 12) == 0x8) {
+        if constexpr (n == 0x0) registers[x] = registers[y];
+        else if constexpr (n == 0x1) registers[x] |= registers[y];
+        else if constexpr (n == 0x2) registers[x] &= registers[y];
+        else if constexpr (n == 0x3) registers[x] ^= registers[y];
+        else if constexpr (n == 0x4) {
+            uint16_t sum = registers[x] + registers[y];
+            registers[0xF] = sum > 255u;
+            registers[x] = sum & 0xFFu;
+        }
+        else if constexpr (n == 0x5) {
+            registers[0xF] = registers[x] > registers[y];
+            registers[x] -= registers[y];
+        }
+        else if constexpr (n == 0x6) {
+            registers[0xF] = registers[x] & 0x1u;
+            registers[x] >>= 1;
+        }
+        else if constexpr (n == 0x7) {
+            registers[0xF] = registers[y] > registers[x];
+            registers[x] = registers[y] - registers[x];
+        }
+        else if constexpr (n == 0xE) {
+            registers[0xF] = (registers[x] & 0x80u) >> 7u;
+            registers[x] <<= 1;
+        }
+    }
+    else if constexpr ((Opcode >> 12) == 0x9) {
+        if (registers[x] != registers[y]) chip8.program_counter += 2;
+    }
+    else if constexpr ((Opcode >> 12) == 0xA) chip8.memory_index = nnn;
+    else if constexpr ((Opcode >> 12) == 0xB) chip8.program_counter = registers[0] + nnn;
+    else if constexpr ((Opcode >> 12) == 0xC) delegate<Opcode, &Chip8::op_cxkk>(chip8);
+    else if constexpr ((Opcode >> 12) == 0xD) delegate<Opcode, &Chip8::op_dxyn<DrawMode::Clip>>(chip8);
+    else if constexpr ((Opcode & 0xF00Fu) == 0xE00E) delegate<Opcode, &Chip8::op_ex9e>(chip8);
+    else if constexpr ((Opcode & 0xF00Fu) == 0xE001) delegate<Opcode, &Chip8::op_exa1>(chip8);
+    else if constexpr ((Opcode >> 12) == 0xF) {
+        if constexpr (kk == 0x07) registers[x] = chip8.delay_timer;
+        else if constexpr (kk == 0x0A) delegate<Opcode, &Chip8::op_fx0a>(chip8);
+        else if constexpr (kk == 0x15) chip8.delay_timer = registers[x];
+        else if constexpr (kk == 0x18) chip8.sound_timer = registers[x];
+        else if constexpr (kk == 0x1E) chip8.memory_index += registers[x];
+        else if constexpr (kk == 0x29) chip8.memory_index = FONTSET_START_ADDRESS + (5 * registers[x]);
+        else if constexpr (kk == 0x33) delegate<Opcode, &Chip8::op_fx33>(chip8);
+        else if constexpr (kk == 0x55) delegate<Opcode, &Chip8::op_fx55<false>>(chip8);
+        else if constexpr (kk == 0x65) delegate<Opcode, &Chip8::op_fx65<false>>(chip8);
+    }
+    //Anything else is the null opcode
+}
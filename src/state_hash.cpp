@@ -0,0 +1,122 @@
+#include "state_hash.hpp"
+#include <cstring>
+
+namespace {
+
+//splitmix64 finalizer
+uint64_t mix(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xBF58476D1CE4E5B9ull;
+    value ^= value >> 27;
+    value *= 0x94D049BB133111EBull;
+    value ^= value >> 31;
+    return value;
+}
+
+//Bytes are read 8 at a time, every caller passes a multiple of 8
+uint64_t hashWords(uint64_t seed, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = mix(seed);
+    for (size_t i = 0; i < size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = mix(hash ^ word);
+    }
+    return hash;
+}
+
+}
+
+StateHash::StateHash(Chip8& chip8) : chip8(chip8), machine(chip8.machine) {
+    rehashAll();
+}
+
+void StateHash::rehashAll() {
+    machine = chip8.machine;
+    chip8.takeDirtyPages();
+    chip8.takeDirtyRows();
+
+    memory_sum = 0;
+    for (unsigned int page = 0; page < 64; page++) {
+        pages[page] = hashPage(chip8, page);
+        memory_sum += pages[page];
+    }
+    video_sum = 0;
+    for (unsigned int row = 0; row < 32; row++) {
+        rows[row] = hashRow(chip8, row);
+        video_sum += rows[row];
+    }
+}
+
+uint64_t StateHash::update() {
+    //A snapshot from another machine reallocates memory, page sizes no longer line up
+    if (chip8.machine != machine) rehashAll();
+
+    uint64_t dirty_pages = chip8.takeDirtyPages();
+    for (unsigned int page = 0; dirty_pages; page++, dirty_pages >>= 1) {
+        if (!(dirty_pages & 1u)) continue;
+        memory_sum -= pages[page];
+        pages[page] = hashPage(chip8, page);
+        memory_sum += pages[page];
+    }
+    uint32_t dirty_rows = chip8.takeDirtyRows();
+    for (unsigned int row = 0; dirty_rows; row++, dirty_rows >>= 1) {
+        if (!(dirty_rows & 1u)) continue;
+        video_sum -= rows[row];
+        rows[row] = hashRow(chip8, row);
+        video_sum += rows[row];
+    }
+
+    return mix(memory_sum ^ mix(video_sum ^ hashCpu(chip8)));
+}
+
+uint64_t StateHash::full(const Chip8& chip8) {
+    uint64_t memory_sum = 0;
+    uint64_t video_sum = 0;
+    for (unsigned int page = 0; page < 64; page++) memory_sum += hashPage(chip8, page);
+    for (unsigned int row = 0; row < 32; row++) video_sum += hashRow(chip8, row);
+
+    return mix(memory_sum ^ mix(video_sum ^ hashCpu(chip8)));
+}
+
+uint64_t StateHash::hashPage(const Chip8& chip8, unsigned int page) {
+    uint8_t memory[XO_MEM_SIZE / 64];
+    size_t size = size_t{1} << chip8.page_shift;
+    chip8.readBlock(page * size, memory, size);
+    return hashWords(page, memory, size);
+}
+
+//Same row numbering as the dirty bits, a 128x64 row pair covers both bitplanes
+uint64_t StateHash::hashRow(const Chip8& chip8, unsigned int row) {
+    if (chip8.machine == Machine::Chip8) return hashWords(0x100 + row, &chip8.video[row], sizeof(chip8.video[row]));
+
+    uint64_t hash = 0x200 + row;
+    for (unsigned int plane = 0; plane < PLANE_COUNT; plane++) {
+        hash = hashWords(hash, chip8.xvideo[plane][2 * row], 2 * sizeof(chip8.xvideo[plane][2 * row]));
+    }
+    return hash;
+}
+
+uint64_t StateHash::hashCpu(const Chip8& chip8) {
+    uint8_t cpu[80]{};
+    size_t used = 0;
+    auto append = [&](const void* field, size_t size) {
+        memcpy(&cpu[used], field, size);
+        used += size;
+    };
+
+    append(chip8.registers, sizeof(chip8.registers));
+    append(chip8.stack, sizeof(chip8.stack));
+    append(&chip8.memory_index, sizeof(chip8.memory_index));
+    append(&chip8.program_counter, sizeof(chip8.program_counter));
+    append(&chip8.stack_pointer, sizeof(chip8.stack_pointer));
+    append(&chip8.delay_timer, sizeof(chip8.delay_timer));
+    append(&chip8.sound_timer, sizeof(chip8.sound_timer));
+    append(&chip8.rng.state, sizeof(chip8.rng.state));
+    uint8_t display[3] = {chip8.hires, chip8.plane_mask, chip8.pitch};
+    append(display, sizeof(display));
+
+    uint64_t hash = hashWords(0x300, cpu, sizeof(cpu));
+    return hashWords(hash ^ static_cast<uint64_t>(chip8.machine), chip8.flags, sizeof(chip8.flags))
+        ^ hashWords(0x400, chip8.audio_pattern, sizeof(chip8.audio_pattern));
+}
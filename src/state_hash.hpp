@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include "chip8.hpp"
+
+//Rolling hash of a machine's whole state, for comparing engines run side by side
+//Memory and display are hashed per page and per row and only rehashed where the machine
+//reports writes (takeDirtyPages, takeDirtyRows), so it owns those bits: don't use it on a
+//machine whose frontend also takes them. CPU registers, stack, timers and the rest of the
+//small state are rehashed on every update, they are a few dozen bytes
+class StateHash {
+    public:
+        explicit StateHash(Chip8& chip8);
+
+        //Hash of the current state, rehashing what changed since the last call
+        uint64_t update();
+
+        //Hash of the current state computed from scratch, equals update() when tracking is right
+        static uint64_t full(const Chip8& chip8);
+
+    private:
+        static uint64_t hashPage(const Chip8& chip8, unsigned int page);
+        static uint64_t hashRow(const Chip8& chip8, unsigned int row);
+        static uint64_t hashCpu(const Chip8& chip8);
+
+        void rehashAll();
+
+        Chip8& chip8;
+        Machine machine;
+        uint64_t pages[64]{};
+        uint64_t rows[32]{};
+        //Sums of the page and row hashes, kept up to date as they change
+        uint64_t memory_sum{};
+        uint64_t video_sum{};
+};
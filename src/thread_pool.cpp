@@ -0,0 +1,93 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threads)
+    :queues(threads ? threads : std::max(1u, std::thread::hardware_concurrency())) {
+
+    for (unsigned int i = 0; i < queues.size(); i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        stopping = true;
+    }
+    work_ready.notify_all();
+
+    for (std::thread& worker : workers) worker.join();
+}
+
+unsigned int ThreadPool::size() const {
+    return static_cast<unsigned int>(queues.size());
+}
+
+//Jobs are spread round-robin, idle workers rebalance by stealing
+//Counted before it's pushed, a worker may take the job as soon as it's in a queue
+void ThreadPool::submit(Job job) {
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        pending++;
+        queued++;
+    }
+    Queue& queue = queues[next_queue++ % queues.size()];
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.jobs.push_back(std::move(job));
+    }
+    work_ready.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> guard(state_lock);
+    work_done.wait(guard, [this] { return pending == 0; });
+}
+
+bool ThreadPool::popLocal(unsigned int index, Job& job) {
+    Queue& queue = queues[index];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.jobs.empty()) return false;
+
+    job = std::move(queue.jobs.back());
+    queue.jobs.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(unsigned int index, Job& job) {
+    for (unsigned int i = 1; i < queues.size(); i++) {
+        Queue& victim = queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (victim.jobs.empty()) continue;
+
+        job = std::move(victim.jobs.front());
+        victim.jobs.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(unsigned int index) {
+    Job job;
+
+    while (true) {
+        if (popLocal(index, job) || steal(index, job)) {
+            {
+                std::lock_guard<std::mutex> guard(state_lock);
+                queued--;
+            }
+            job();
+            job = nullptr;
+
+            std::lock_guard<std::mutex> guard(state_lock);
+            if (--pending == 0) work_done.notify_all();
+            continue;
+        }
+
+        //Nothing to run anywhere, sleep until submit() queues a job or shutdown
+        //Another worker may take the job first, then this one finds nothing and sleeps again
+        std::unique_lock<std::mutex> guard(state_lock);
+        if (stopping) return;
+        work_ready.wait(guard, [this] { return stopping || queued > 0; });
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Work-stealing thread pool
+//Each worker owns a deque; it pops its own newest job and steals the oldest job from others when empty
+class ThreadPool {
+    public:
+        typedef std::function<void()> Job;
+
+        //Zero threads uses one per hardware core
+        explicit ThreadPool(unsigned int threads = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        void submit(Job job);
+        //Blocks until every submitted job has finished
+        void wait();
+
+        unsigned int size() const;
+
+    private:
+        struct Queue {
+            std::mutex lock;
+            std::deque<Job> jobs;
+        };
+
+        std::vector<std::thread> workers;
+        std::vector<Queue> queues;
+
+        std::mutex state_lock;
+        std::condition_variable work_ready;
+        std::condition_variable work_done;
+        std::atomic<unsigned int> next_queue{0};
+        //Jobs submitted and not finished, and of those the ones no worker has taken yet
+        unsigned int pending{};
+        unsigned int queued{};
+        bool stopping{};
+
+        void workerLoop(unsigned int index);
+        bool popLocal(unsigned int index, Job& job);
+        bool steal(unsigned int index, Job& job);
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+//Lock-free single-producer single-consumer triple buffer
+//The producer always has a slot to write into and the consumer always reads the newest
+//complete one; neither side waits, intermediate values the consumer misses are dropped
+template <typename T>
+class TripleBuffer {
+    public:
+        //Producer: fill back(), then publish() makes it the newest complete value
+        T& back() {
+            return slots[back_index];
+        }
+
+        void publish() {
+            uint8_t previous = middle.exchange(back_index | FRESH, std::memory_order_acq_rel);
+            back_index = previous & INDEX;
+        }
+
+        //Consumer: takes the newest published value if there is one since the last call
+        bool update() {
+            if (!(middle.load(std::memory_order_acquire) & FRESH)) return false;
+
+            uint8_t previous = middle.exchange(front_index, std::memory_order_acq_rel);
+            front_index = previous & INDEX;
+            return true;
+        }
+
+        const T& front() const {
+            return slots[front_index];
+        }
+
+    private:
+        static const uint8_t INDEX = 0x3;
+        //Set on the middle index when it holds a value the consumer hasn't taken yet
+        static const uint8_t FRESH = 0x4;
+
+        T slots[3]{};
+        //Producer and consumer each own one index, the middle one is swapped between them
+        alignas(64) std::atomic<uint8_t> middle{1};
+        alignas(64) uint8_t back_index{0};
+        alignas(64) uint8_t front_index{2};
+};
@@ -0,0 +1,181 @@
+#include "vec_env.hpp"
+#include <algorithm>
+
+namespace {
+
+//Byte x of entry b is bit 7 - x of b, so a packed byte expands with one 8-byte copy
+struct ExpandTable {
+    uint8_t bytes[256][8];
+
+    ExpandTable() {
+        for (unsigned int value = 0; value < 256; value++) {
+            for (unsigned int x = 0; x < 8; x++) bytes[value][x] = (value >> (7 - x)) & 1u;
+        }
+    }
+};
+
+const ExpandTable expand_table;
+
+//Writes a packed row of one 64-bit word as 8 bytes, leftmost pixel first
+void packWord(uint64_t word, uint8_t* out) {
+    for (unsigned int i = 0; i < 8; i++) out[i] = static_cast<uint8_t>(word >> (56 - 8 * i));
+}
+
+//Writes 64 pixels one byte each, plane 1 (if given) in bit 1
+void expandWord(uint64_t word, const uint64_t* plane1_word, uint8_t* out) {
+    for (unsigned int i = 0; i < 8; i++) {
+        uint64_t pixels;
+        memcpy(&pixels, expand_table.bytes[(word >> (56 - 8 * i)) & 0xFFu], sizeof(pixels));
+        if (plane1_word) {
+            uint64_t high;
+            memcpy(&high, expand_table.bytes[(*plane1_word >> (56 - 8 * i)) & 0xFFu], sizeof(high));
+            pixels |= high << 1;
+        }
+        memcpy(out + 8 * i, &pixels, sizeof(pixels));
+    }
+}
+
+}
+
+VecEnv::VecEnv(const RomImage& image, unsigned int count, const VecEnvOptions& options)
+    :options(options), count(count), pool(options.threads) {
+
+    initial.setMachine(options.machine);
+    initial.loadRom(image);
+    //setMachine() already selected the machine's defaults
+    if (options.quirks) initial.setQuirks(*options.quirks);
+
+    //Decodes everything the ROM image holds into pages every environment shares
+    //Forking initial only reads it, so workers can restart environments in parallel
+    initial.seal();
+    machines.assign(count, initial);
+    //Each environment keeps its engine from here on, see restart()
+    if (options.engine != Engine::Interpreter) {
+        for (Chip8& chip8 : machines) chip8.setEngine(options.engine);
+    }
+    episodes.assign(count, 0);
+    instructions.assign(count, 0);
+
+    //A few chunks per thread, so workers that finish early steal from slow environments
+    chunks = std::max(1u, std::min(count, 4 * pool.size()));
+
+    for (unsigned int env = 0; env < count; env++) restart(env);
+}
+
+void VecEnv::setRewardHook(RewardHook hook) {
+    reward_hook = std::move(hook);
+}
+
+void VecEnv::setDoneHook(DoneHook hook) {
+    done_hook = std::move(hook);
+}
+
+unsigned int VecEnv::size() const {
+    return count;
+}
+
+size_t VecEnv::observationSize() const {
+    size_t pixels = options.machine == Machine::Chip8 ? VIDEO_WIDTH * VIDEO_HEIGHT : HIRES_WIDTH * HIRES_HEIGHT;
+    if (options.format == ObservationFormat::Bytes) return pixels;
+    return options.machine == Machine::XoChip ? PLANE_COUNT * pixels / 8 : pixels / 8;
+}
+
+const Chip8& VecEnv::machine(unsigned int env) const {
+    return machines[env];
+}
+
+uint64_t VecEnv::instructionCount() const {
+    uint64_t total = 0;
+    for (uint64_t executed : instructions) total += executed;
+    return total;
+}
+
+//A JIT isn't created again for every episode, it only drops the previous episode's blocks
+void VecEnv::restart(unsigned int env) {
+    Chip8& chip8 = machines[env];
+    chip8.restartFrom(initial);
+    chip8.seed(options.seed + env + episodes[env]++ * count);
+}
+
+void VecEnv::reset(uint8_t* observations) {
+    args = {true, nullptr, 0, nullptr, nullptr, observations};
+    runAll();
+}
+
+void VecEnv::step(const uint16_t* actions, unsigned int frames_per_step, float* rewards, uint8_t* dones, uint8_t* observations) {
+    args = {false, actions, frames_per_step, rewards, dones, observations};
+    runAll();
+}
+
+//Environments are split into contiguous chunks, each job writes only its own slots of the outputs
+void VecEnv::runAll() {
+    //Handing a single chunk to a worker would only add a thread switch
+    if (chunks == 1) {
+        runRange(0, count);
+        return;
+    }
+    for (unsigned int chunk = 0; chunk < chunks; chunk++) {
+        unsigned int first = static_cast<unsigned int>(uint64_t{count} * chunk / chunks);
+        unsigned int last = static_cast<unsigned int>(uint64_t{count} * (chunk + 1) / chunks);
+        pool.submit([this, first, last] { runRange(first, last); });
+    }
+    pool.wait();
+}
+
+void VecEnv::runRange(unsigned int first, unsigned int last) {
+    for (unsigned int env = first; env < last; env++) {
+        Chip8& chip8 = machines[env];
+
+        if (args.reset) restart(env);
+        else {
+            uint16_t keys = args.actions ? args.actions[env] : 0;
+            for (unsigned int key = 0; key < KEY_COUNT; key++) chip8.keypad[key] = (keys >> key) & 1u;
+
+            float reward = 0;
+            bool done = false;
+            for (unsigned int frame = 0; frame < args.frames && !done; frame++) {
+                instructions[env] += chip8.run(options.instructions_per_frame);
+                chip8.tickTimers();
+                if (reward_hook) reward += reward_hook(chip8, env);
+                done = done_hook && done_hook(chip8, env);
+            }
+            if (done) restart(env);
+
+            if (args.rewards) args.rewards[env] = reward;
+            if (args.dones) args.dones[env] = done;
+        }
+
+        if (args.observations) writeObservation(env, args.observations + env * observationSize());
+    }
+}
+
+void VecEnv::writeObservation(unsigned int env, uint8_t* out) const {
+    const Chip8& chip8 = machines[env];
+    bool packed = options.format == ObservationFormat::Packed;
+
+    if (options.machine == Machine::Chip8) {
+        for (unsigned int y = 0; y < VIDEO_HEIGHT; y++) {
+            if (packed) packWord(chip8.video[y], out + y * VIDEO_WIDTH / 8);
+            else expandWord(chip8.video[y], nullptr, out + y * VIDEO_WIDTH);
+        }
+        return;
+    }
+
+    //Packed planes follow each other, bytes combine the planes per pixel
+    if (packed) {
+        unsigned int planes = options.machine == Machine::XoChip ? PLANE_COUNT : 1;
+        for (unsigned int plane = 0; plane < planes; plane++) {
+            for (unsigned int y = 0; y < HIRES_HEIGHT; y++) {
+                for (unsigned int word = 0; word < 2; word++) packWord(chip8.xvideo[plane][y][word], out + 8 * word);
+                out += HIRES_WIDTH / 8;
+            }
+        }
+        return;
+    }
+    for (unsigned int y = 0; y < HIRES_HEIGHT; y++) {
+        for (unsigned int word = 0; word < 2; word++) {
+            const uint64_t* plane1 = options.machine == Machine::XoChip ? &chip8.xvideo[1][y][word] : nullptr;
+            expandWord(chip8.xvideo[0][y][word], plane1, out + y * HIRES_WIDTH + 64 * word);
+        }
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+#include "chip8.hpp"
+#include "rom.hpp"
+#include "thread_pool.hpp"
+
+//Layout of one environment's observation
+enum class ObservationFormat : uint8_t {
+    //1 bit per pixel, rows of width / 8 bytes, most significant bit is the leftmost pixel
+    //XO-CHIP writes both bitplanes, plane 0 first
+    Packed,
+    //1 byte per pixel, bit p set if the pixel is lit on plane p (0 or 1 before XO-CHIP)
+    Bytes
+};
+
+struct VecEnvOptions {
+    Machine machine = Machine::Chip8;
+    Engine engine = Engine::Interpreter;
+    unsigned int instructions_per_frame = 10;
+    //A parseQuirks() profile, Quirks::defaults(machine) if left unset
+    std::optional<Quirks> quirks;
+    ObservationFormat format = ObservationFormat::Packed;
+    //Environment e starts episode n with seed + e + n * count
+    uint32_t seed = 0;
+    //Zero uses one per hardware core
+    unsigned int threads = 0;
+};
+
+//Vectorized environment for training agents
+//count machines run copies of one ROM and are stepped together across a thread pool. Frames are
+//the scheduler's fixed timestep (a budget of instructions, then a timer tick) without its host
+//pacing and timing, which would cost more than a frame of Tetris. Episodes
+//start from forks of one prepared machine, so resets share its memory until they write
+//Observations go straight from each display into the caller's buffer, rewards and episode
+//ends come from hooks reading the machine. Steps don't allocate per environment
+class VecEnv {
+    public:
+        //Called after every frame, from worker threads: a hook runs for several environments at once
+        typedef std::function<float(const Chip8& chip8, unsigned int env)> RewardHook;
+        typedef std::function<bool(const Chip8& chip8, unsigned int env)> DoneHook;
+
+        VecEnv(const RomImage& image, unsigned int count, const VecEnvOptions& options = VecEnvOptions());
+
+        VecEnv(const VecEnv&) = delete;
+        VecEnv& operator=(const VecEnv&) = delete;
+
+        //Without a reward hook rewards are 0, without a done hook episodes never end
+        void setRewardHook(RewardHook hook);
+        void setDoneHook(DoneHook hook);
+
+        unsigned int size() const;
+        //Bytes per environment in observation buffers, which hold size() of them back to back
+        size_t observationSize() const;
+
+        //Restarts every environment, then writes observations if not null
+        void reset(uint8_t* observations);
+
+        //Holds the keys in actions[e] (bit k is key k) on environment e for frames_per_step frames
+        //rewards[e] sums the reward hook over those frames. An environment whose done hook fires
+        //stops there, sets dones[e] and restarts, its observation is then the new episode's first
+        //Any output may be null to skip it
+        void step(const uint16_t* actions, unsigned int frames_per_step, float* rewards, uint8_t* dones, uint8_t* observations);
+
+        //Environments are only safe to read between calls
+        const Chip8& machine(unsigned int env) const;
+        //Instructions executed over all environments and episodes
+        uint64_t instructionCount() const;
+
+    private:
+        //Arguments of the step or reset being run, read by the workers
+        struct StepArgs {
+            bool reset;
+            const uint16_t* actions;
+            unsigned int frames;
+            float* rewards;
+            uint8_t* dones;
+            uint8_t* observations;
+        };
+
+        VecEnvOptions options;
+        unsigned int count;
+        //Every episode starts from a fork of this machine
+        Chip8 initial;
+        std::vector<Chip8> machines;
+        std::vector<uint32_t> episodes;
+        std::vector<uint64_t> instructions;
+
+        RewardHook reward_hook;
+        DoneHook done_hook;
+
+        ThreadPool pool;
+        unsigned int chunks;
+        StepArgs args{};
+
+        void restart(unsigned int env);
+        void runAll();
+        void runRange(unsigned int first, unsigned int last);
+        void writeObservation(unsigned int env, uint8_t* out) const;
+};